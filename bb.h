@@ -5,6 +5,7 @@
 #include <vector>
 #include <utility>
 #include "isa.h"
+#include "mem.h"
 
 // Basic block -- a block of instructions executed sequentially
 
@@ -36,10 +37,34 @@ typedef std::vector< isa::Instr > Instructions;
 // branch-target buffer
 typedef std::vector< Address > BTB;
 
+// get the number of GPRs a sequence of instructions needs, i.e. its highest register operand plus one
+inline size_t getRegCount(const Instructions& seq)
+{
+	using namespace isa;
+	size_t count = 0;
+
+	for (const auto it : seq) {
+		const Opcode op = it.getOpcode();
+		if (!isOpcodeValid(op) || op_nop == op)
+			continue;
+
+		// li carries an immediate in its trailing operands
+		const size_t noperand = op_li == op ? 1 : 3;
+		for (size_t i = 0; i < noperand; ++i) {
+			const Operand reg = it.getOperand(i);
+			if (reg_invalid != reg && count <= reg)
+				count = size_t(reg) + 1;
+		}
+	}
+
+	return count;
+}
+
 class BasicBlock {
 	Address start; // basic-block start address
 	BTB exit; // branch targets for exit from the basic block
 	Instructions instr; // basic-block instructions
+	uint32_t revision = 0; // number of edits to the instruction sequence
 
 	BasicBlock& operator =(const BasicBlock&) = delete;
 
@@ -53,6 +78,8 @@ public:
 	Address getExitTargetAddress(const size_t index) const;
 	// get the immutable instruction sequence of the basic block
 	const Instructions& getSequence() const;
+	// get the number of edits to the instruction sequence so far
+	uint32_t getRevision() const { return revision; }
 	// append instruction to basic block
 	void addInstr(const isa::Instr&);
 	// replace existing instruction in the basic block
@@ -61,6 +88,8 @@ public:
 	bool validate();
 	// check the validity of the basic block
 	bool isValid() const { return isAddrValid(start); }
+	// get bytes taken on the heap by the basic block, its own body excluded
+	mem::Usage memoryUsage() const;
 };
 
 inline Address BasicBlock::getStartAddress() const
@@ -82,6 +111,7 @@ inline void BasicBlock::addInstr(const isa::Instr& newInstr)
 {
 	start = invalidateAddr(start);
 	instr.push_back(newInstr);
+	++revision;
 }
 
 inline void BasicBlock::replaceInstr(const size_t index, const isa::Instr newInstr)
@@ -89,6 +119,15 @@ inline void BasicBlock::replaceInstr(const size_t index, const isa::Instr newIns
 	start = invalidateAddr(start);
 	assert(index < instr.size());
 	instr[index] = newInstr;
+	++revision;
+}
+
+inline mem::Usage BasicBlock::memoryUsage() const
+{
+	mem::Usage usage;
+	mem::addVector(instr, usage.instructions, usage);
+	mem::addVector(exit, usage.btb, usage);
+	return usage;
 }
 
 // check the validity of the basic block; invalid BBs are:
@@ -19,9 +19,20 @@ else
 	)
 fi
 
+CXX_FLAGS=(
+	-std=c++17
+	-Wno-switch
+	-Wno-logical-op-parentheses
+	-Wno-shift-op-parentheses
+	-fno-rtti
+	-fno-exceptions
+	-pthread
+)
+
 as stringx.s -o stringx.o
-${CXX} main.cpp -std=c++17 -Wno-switch -Wno-logical-op-parentheses -Wno-shift-op-parentheses -fno-rtti -fno-exceptions ${OPT_FLAGS[@]} -c -o main.o
-${CXX} main.o stringx.o -o hello
+${CXX} main.cpp ${CXX_FLAGS[@]} ${OPT_FLAGS[@]} -c -o main.o
+${CXX} cfg.cpp ${CXX_FLAGS[@]} ${OPT_FLAGS[@]} -c -o cfg.o
+${CXX} main.o cfg.o stringx.o -pthread -o hello
 
 if [ `which ctags` ]; then
 	ctags --language-force=c++ --totals *{.h,.hpp,.cpp}
@@ -0,0 +1,129 @@
+#if !defined(__builder_h)
+#define __builder_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "bb.h"
+#include "cfg.h"
+
+// Concurrent CFG construction -- several threads add BBs at once, each to a run of its own; the runs get sorted and built
+// into CFGs of their own in parallel, then spliced into the target CFG, rejecting BBs overlapping others just like a
+// serial build would; splicing relinks the tree nodes built in parallel, so the serial part neither allocates nor copies,
+// and takes constant time per BB for runs of disjoint address ranges, e.g. chunks of an image
+
+namespace build {
+
+template < size_t RegCount >
+class BasicBuilder {
+public:
+	typedef cfg::BasicControlFlowGraph< RegCount > ControlFlowGraph;
+
+private:
+	// BBs added by a single thread; padded to keep runs fed by different threads off each other's cache lines
+	struct alignas(64) Run {
+		std::vector< bb::BasicBlock > blocks; // BBs, in order of addition
+		std::vector< uint32_t > order; // indices of BBs, in address order once sorted
+		ControlFlowGraph graph; // BBs, once built
+		bool valid = true; // no BBs of the run overlap each other
+	};
+
+	std::vector< Run > runs;
+
+public:
+	// set up the given number of runs, typically one per thread
+	explicit BasicBuilder(const size_t runCount) : runs(std::max(runCount, size_t(1))) {}
+
+	// get number of runs
+	size_t getRunCount() const { return runs.size(); }
+	// add BB to a run; distinct runs can be fed concurrently, a single run by one thread at a time
+	void addBasicBlock(const size_t run, bb::BasicBlock&& block) { runs[run].blocks.push_back(std::move(block)); }
+
+	// sort all runs and build each into a CFG of its own, a thread per run, then splice those into the given CFG in order
+	// of their lowest addresses; BBs overlapping others, added before or from any run, get rejected and reported; runs
+	// are left empty; return false if any BB was rejected
+	bool build(ControlFlowGraph&);
+};
+
+typedef BasicBuilder< reg::reg_count_max > Builder;
+
+template < size_t RegCount >
+inline bool BasicBuilder< RegCount >::build(ControlFlowGraph& graph)
+{
+	using namespace bb;
+
+	const auto less = [](const BasicBlock& lhs, const BasicBlock& rhs) -> bool {
+		return uint32_t(lhs.getStartAddress()) < uint32_t(rhs.getStartAddress());
+	};
+
+	// BBs are not assignable, so sort their indices instead, then build the run's CFG in address order
+	const auto buildRun = [&](Run& run) {
+		run.order.resize(run.blocks.size());
+		for (size_t i = 0; i < run.order.size(); ++i)
+			run.order[i] = uint32_t(i);
+
+		const auto lessIndex = [&](const uint32_t lhs, const uint32_t rhs) -> bool {
+			return less(run.blocks[lhs], run.blocks[rhs]);
+		};
+
+		if (!std::is_sorted(run.order.begin(), run.order.end(), lessIndex))
+			std::stable_sort(run.order.begin(), run.order.end(), lessIndex);
+
+		// BBs past the end of the CFG get appended; any others take the general path
+		for (const auto it : run.order) {
+			BasicBlock& block = run.blocks[it];
+			const Address start = block.getStartAddress();
+
+			if (!run.graph.appendBasicBlock(std::move(block)) && !run.graph.addBasicBlock(std::move(block))) {
+				fprintf(stderr, "error: overlapping BB at %08x\n", uint32_t(start));
+				run.valid = false;
+			}
+		}
+
+		run.blocks.clear();
+		run.order.clear();
+	};
+
+	std::vector< std::thread > pool;
+	for (size_t i = 1; i < runs.size(); ++i)
+		pool.push_back(std::thread(buildRun, std::ref(runs[i])));
+
+	buildRun(runs[0]);
+
+	for (auto& it : pool)
+		it.join();
+
+	// splice the runs in order of their lowest addresses, so that runs of disjoint address ranges only ever append
+	std::vector< Run* > order;
+	for (auto& it : runs) {
+		if (it.graph.begin() != it.graph.end())
+			order.push_back(&it);
+	}
+
+	std::sort(order.begin(), order.end(), [](const Run* const lhs, const Run* const rhs) -> bool {
+		return uint32_t(lhs->graph.begin()->getStartAddress()) < uint32_t(rhs->graph.begin()->getStartAddress());
+	});
+
+	bool success = true;
+	for (const auto it : order) {
+		success = it->valid && success;
+
+		if (graph.spliceBasicBlocks(it->graph))
+			continue;
+
+		for (const auto& jt : it->graph)
+			fprintf(stderr, "error: overlapping BB at %08x\n", uint32_t(jt.getStartAddress()));
+
+		it->graph = ControlFlowGraph();
+		success = false;
+	}
+
+	return success;
+}
+
+} // namespace build
+
+#endif // __builder_h
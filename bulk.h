@@ -0,0 +1,248 @@
+#if !defined(__bulk_h)
+#define __bulk_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "isa.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Bulk instruction validation -- classify a contiguous array of instructions many at a time, comparing the opcode and
+// operand bytes of several 4-byte records per SIMD op, into bitmaps of invalid, branch and load-immediate instructions
+
+namespace bulk {
+
+// a bit per instruction: instruction i at bit i % 64 of word i / 64
+typedef std::vector< uint64_t > Bitmap;
+
+struct Classes {
+	Bitmap invalid; // invalid instructions, as per Instr::getOpcode
+	Bitmap branch; // valid branches
+	Bitmap load; // valid loads of immediates
+};
+
+// check the bit of an instruction in a bitmap
+inline bool isSet(const Bitmap& bitmap, const size_t index)
+{
+	return 0 != (bitmap[index / 64] >> index % 64 & 1);
+}
+
+// An instruction is valid iff its opcode is known, and the reg-invalid status of its operands matches what the opcode
+// wants, for the operands the opcode cares about. Operand status is a 3-bit pattern p: bit k set iff operand rk is
+// reg-invalid; the instruction is valid iff ((p ^ want[op]) & care[op]) == 0.
+namespace detail {
+
+constexpr uint8_t care[isa::op__count] = {
+	7, // nop: all operands reg-invalid
+	1, // li: r0 a register, r1..r2 the immediate
+	7, // push: r0 a register, r1..r2 reg-invalid
+	7, // pop: ditto
+	7, // br: ditto
+	7, // cbr: all operands registers
+	7, // op2: r0..r1 registers, r2 reg-invalid
+	7  // op3: all operands registers
+};
+
+constexpr uint8_t want[isa::op__count] = {
+	7,
+	0,
+	6,
+	6,
+	6,
+	0,
+	4,
+	0
+};
+
+// operand-status bits, per byte of an instruction: r0, r1, r2, opcode
+constexpr uint32_t status_bits = 0x00040201;
+
+// classify instructions one by one; return number of invalid ones
+inline size_t classifyScalar(const isa::Instr* const instr, const size_t first, const size_t last, Classes& classes)
+{
+	using namespace isa;
+	size_t count = 0;
+
+	for (size_t i = first; i < last; ++i) {
+		const Opcode op = instr[i].getOpcode();
+		const uint64_t bit = uint64_t(1) << i % 64;
+
+		if (!isOpcodeValid(op)) {
+			classes.invalid[i / 64] |= bit;
+			++count;
+		}
+		else if (isBranch(op))
+			classes.branch[i / 64] |= bit;
+		else if (op_li == op)
+			classes.load[i / 64] |= bit;
+	}
+
+	return count;
+}
+
+#if defined(__AVX2__)
+
+constexpr size_t lane_count = 8;
+
+// classify lane-count instructions; return their bits in the low bits of each bitmap word
+inline void classifyLanes(const isa::Instr* const instr, uint32_t& invalid, uint32_t& branch, uint32_t& load)
+{
+	const __m128i careTable = _mm_setr_epi8(care[0], care[1], care[2], care[3], care[4], care[5], care[6], care[7],
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i wantTable = _mm_setr_epi8(want[0], want[1], want[2], want[3], want[4], want[5], want[6], want[7],
+		0, 0, 0, 0, 0, 0, 0, 0);
+
+	const __m256i v = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(instr));
+	const __m256i low = _mm256_set1_epi32(0xff);
+
+	// operand status in the low byte of each lane
+	__m256i p = _mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(-1)), _mm256_set1_epi32(status_bits));
+	p = _mm256_or_si256(p, _mm256_or_si256(_mm256_srli_epi32(p, 8), _mm256_srli_epi32(p, 16)));
+
+	// opcode in the low byte of each lane, zeros above; look up what it cares about and wants
+	const __m256i op = _mm256_srli_epi32(v, 24);
+	const __m256i c = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(careTable), op), low);
+	const __m256i w = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(wantTable), op);
+
+	const __m256i known = _mm256_cmpgt_epi32(_mm256_set1_epi32(isa::op__count), op);
+	const __m256i match = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_xor_si256(p, w), c), _mm256_setzero_si256());
+	const __m256i valid = _mm256_and_si256(known, match);
+
+	const __m256i isBranch = _mm256_or_si256(
+		_mm256_cmpeq_epi32(op, _mm256_set1_epi32(isa::op_br)),
+		_mm256_cmpeq_epi32(op, _mm256_set1_epi32(isa::op_cbr)));
+	const __m256i isLoad = _mm256_cmpeq_epi32(op, _mm256_set1_epi32(isa::op_li));
+
+	invalid = uint32_t(~_mm256_movemask_ps(_mm256_castsi256_ps(valid))) & 0xff;
+	branch = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(valid, isBranch))));
+	load = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(valid, isLoad))));
+}
+
+#elif defined(__SSE2__)
+
+constexpr size_t lane_count = 4;
+
+// classify lane-count instructions; return their bits in the low bits of each bitmap word
+inline void classifyLanes(const isa::Instr* const instr, uint32_t& invalid, uint32_t& branch, uint32_t& load)
+{
+	const __m128i v = _mm_loadu_si128(reinterpret_cast< const __m128i* >(instr));
+
+	// operand status in the low byte of each lane
+	__m128i p = _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(-1)), _mm_set1_epi32(status_bits));
+	p = _mm_or_si128(p, _mm_or_si128(_mm_srli_epi32(p, 8), _mm_srli_epi32(p, 16)));
+
+	// opcode in the low byte of each lane, zeros above; no byte shuffles in SSE2, so match each opcode in turn
+	const __m128i op = _mm_srli_epi32(v, 24);
+	__m128i valid = _mm_setzero_si128();
+
+	for (size_t i = 0; i < isa::op__count; ++i) {
+		const __m128i sel = _mm_cmpeq_epi32(op, _mm_set1_epi32(int(i)));
+		const __m128i mismatch = _mm_and_si128(_mm_xor_si128(p, _mm_set1_epi32(want[i])), _mm_set1_epi32(care[i]));
+		valid = _mm_or_si128(valid, _mm_and_si128(sel, _mm_cmpeq_epi32(mismatch, _mm_setzero_si128())));
+	}
+
+	const __m128i isBranch = _mm_or_si128(
+		_mm_cmpeq_epi32(op, _mm_set1_epi32(isa::op_br)),
+		_mm_cmpeq_epi32(op, _mm_set1_epi32(isa::op_cbr)));
+	const __m128i isLoad = _mm_cmpeq_epi32(op, _mm_set1_epi32(isa::op_li));
+
+	invalid = uint32_t(~_mm_movemask_ps(_mm_castsi128_ps(valid))) & 0xf;
+	branch = uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(valid, isBranch))));
+	load = uint32_t(_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(valid, isLoad))));
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+constexpr size_t lane_count = 4;
+
+// classify lane-count instructions; return their bits in the low bits of each bitmap word
+inline void classifyLanes(const isa::Instr* const instr, uint32_t& invalid, uint32_t& branch, uint32_t& load)
+{
+	const uint8_t careTable[16] = { care[0], care[1], care[2], care[3], care[4], care[5], care[6], care[7] };
+	const uint8_t wantTable[16] = { want[0], want[1], want[2], want[3], want[4], want[5], want[6], want[7] };
+	const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+
+	const uint32x4_t v = vld1q_u32(reinterpret_cast< const uint32_t* >(instr));
+
+	// operand status in the low byte of each lane
+	uint32x4_t p = vreinterpretq_u32_u8(vceqq_u8(vreinterpretq_u8_u32(v), vdupq_n_u8(0xff)));
+	p = vandq_u32(p, vdupq_n_u32(status_bits));
+	p = vorrq_u32(p, vorrq_u32(vshrq_n_u32(p, 8), vshrq_n_u32(p, 16)));
+
+	// opcode in the low byte of each lane, zeros above; look up what it cares about and wants
+	const uint32x4_t op = vshrq_n_u32(v, 24);
+	const uint32x4_t c = vandq_u32(vreinterpretq_u32_u8(vqtbl1q_u8(vld1q_u8(careTable), vreinterpretq_u8_u32(op))), vdupq_n_u32(0xff));
+	const uint32x4_t w = vreinterpretq_u32_u8(vqtbl1q_u8(vld1q_u8(wantTable), vreinterpretq_u8_u32(op)));
+
+	const uint32x4_t known = vcltq_u32(op, vdupq_n_u32(isa::op__count));
+	const uint32x4_t match = vceqq_u32(vandq_u32(veorq_u32(p, w), c), vdupq_n_u32(0));
+	const uint32x4_t valid = vandq_u32(known, match);
+
+	const uint32x4_t isBranch = vorrq_u32(vceqq_u32(op, vdupq_n_u32(isa::op_br)), vceqq_u32(op, vdupq_n_u32(isa::op_cbr)));
+	const uint32x4_t isLoad = vceqq_u32(op, vdupq_n_u32(isa::op_li));
+	const uint32x4_t bits = vld1q_u32(laneBits);
+
+	invalid = vaddvq_u32(vbicq_u32(bits, valid));
+	branch = vaddvq_u32(vandq_u32(bits, vandq_u32(valid, isBranch)));
+	load = vaddvq_u32(vandq_u32(bits, vandq_u32(valid, isLoad)));
+}
+
+#else
+
+constexpr size_t lane_count = 0;
+
+#endif
+
+} // namespace detail
+
+// classify a contiguous array of instructions into bitmaps, resized to fit; return number of invalid instructions
+inline size_t classify(const isa::Instr* const instr, const size_t count, Classes& classes)
+{
+	using namespace detail;
+
+	const size_t wordCount = (count + 63) / 64;
+	classes.invalid.assign(wordCount, 0);
+	classes.branch.assign(wordCount, 0);
+	classes.load.assign(wordCount, 0);
+
+	size_t invalidCount = 0;
+	size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON) && defined(__aarch64__)
+	// whole bitmap words, lane-count instructions at a time
+	for (; i + 64 <= count; i += 64) {
+		uint64_t invalid = 0;
+		uint64_t branch = 0;
+		uint64_t load = 0;
+
+		for (size_t j = 0; j < 64; j += lane_count) {
+			uint32_t laneInvalid;
+			uint32_t laneBranch;
+			uint32_t laneLoad;
+			classifyLanes(instr + i + j, laneInvalid, laneBranch, laneLoad);
+
+			invalid |= uint64_t(laneInvalid) << j;
+			branch |= uint64_t(laneBranch) << j;
+			load |= uint64_t(laneLoad) << j;
+		}
+
+		classes.invalid[i / 64] = invalid;
+		classes.branch[i / 64] = branch;
+		classes.load[i / 64] = load;
+		invalidCount += __builtin_popcountll(invalid);
+	}
+
+#endif
+	// remainder, if any
+	return invalidCount + classifyScalar(instr, i, count, classes);
+}
+
+} // namespace bulk
+
+#endif // __bulk_h
@@ -0,0 +1,21 @@
+#include "cfg.h"
+
+// explicit instantiations of the analysis for the GPR-file widths it is specialised for
+
+namespace reg {
+
+template class BasicRegistry< reg_count_16 >;
+template class BasicRegistry< reg_count_32 >;
+template class BasicRegistry< reg_count_64 >;
+template class BasicRegistry< reg_count_max >;
+
+} // namespace reg
+
+namespace cfg {
+
+template class BasicControlFlowGraph< reg::reg_count_16 >;
+template class BasicControlFlowGraph< reg::reg_count_32 >;
+template class BasicControlFlowGraph< reg::reg_count_64 >;
+template class BasicControlFlowGraph< reg::reg_count_max >;
+
+} // namespace cfg
@@ -1,12 +1,17 @@
 #if !defined(__cfg_h)
 #define __cfg_h
 
+#include <stdio.h>
 #include <assert.h>
 #include <utility>
+#include <algorithm>
 #include <vector>
 #include <set>
+#include <unordered_set>
 #include "bb.h"
 #include "reg.h"
+#include "storage.h"
+#include "mem.h"
 
 // Control-flow graph -- nodes constitute basic blocks, edges -- branches to a basic-block start addresses
 
@@ -19,6 +24,41 @@ enum RegOrder {
 	order__count
 };
 
+// BB transfer summary -- the effect of a BB on registry and 'storage', compiled once per BB revision; holds only the
+// registers the BB requires occupied at entry and the steps that alter registry or 'storage', dead ones dropped, and
+// pushes folded away with pops restoring the same register; applying a summary takes a step per surviving write and per
+// unmatched push or pop, rather than one per instruction
+struct Transfer {
+	enum Action : uint8_t {
+		action_load,    // vacate register, then add the immediate to it
+		action_clobber, // vacate register, then add an unknown to it
+		action_push,    // push register values to 'storage', then vacate register
+		action_pop      // vacate register, then add values popped from 'storage' to it
+	};
+
+	struct Step {
+		Action action;
+		reg::Register reg;
+		reg::Value imm; // load immediate; unused otherwise
+	};
+
+	std::vector< reg::Register > uses; // registers required occupied at entry, unique
+	std::vector< Step > steps; // steps, in order of execution
+	size_t popDepth = 0; // 'storage' height required at entry
+	uint32_t revision = 0; // BB revision the summary was compiled from
+	bool compiled = false; // summary was compiled at all
+	bool executable = true; // BB can execute at all -- references no vacated or out-of-file registers
+};
+
+// comparison a cbr branches on, left operand against right; the ISA leaves it unspecified, so it is up to the user
+typedef bool (*Predicate)(const isa::Word lhs, const isa::Word rhs);
+
+// stock predicates; words compare as 31-bit two's complement
+inline bool compareEqual(const isa::Word lhs, const isa::Word rhs) { return uint32_t(lhs) == uint32_t(rhs); }
+inline bool compareNotEqual(const isa::Word lhs, const isa::Word rhs) { return uint32_t(lhs) != uint32_t(rhs); }
+inline bool compareLess(const isa::Word lhs, const isa::Word rhs) { return int32_t(uint32_t(lhs) << 1) < int32_t(uint32_t(rhs) << 1); }
+inline bool compareGreaterEqual(const isa::Word lhs, const isa::Word rhs) { return !compareLess(lhs, rhs); }
+
 struct LessBB {
 	bool operator ()(const bb::BasicBlock& lhs, const bb::BasicBlock& rhs) const {
 		using namespace bb;
@@ -28,51 +68,147 @@ struct LessBB {
 	}
 };
 
-class ControlFlowGraph {
+// CFG whose registries track a GPR file of a compile-time width RegCount
+template < size_t RegCount >
+class BasicControlFlowGraph {
+public:
+	typedef reg::BasicRegistry< RegCount > Registry;
+	typedef storage::Stack Stack;
+
+private:
 	struct BBAndReg : bb::BasicBlock
 	{
 		BBAndReg(const bb::BasicBlock& src) : bb::BasicBlock(src) {}
 		BBAndReg(bb::BasicBlock&& src) : bb::BasicBlock(std::move(src)) {}
 
-		reg::Registry reg[order__count];
+		Registry reg[order__count];
+		Stack stack[order__count];
+		bool entrySet = false; // at-entry state set, directly or via a merge
+		Transfer xfer; // transfer summary
+
+		// states before every checkpoint-interval-th instruction, the first one past the entry on; valid only for the
+		// at-entry state, BB revision and interval they were computed for
+		std::vector< std::pair< Registry, Stack > > checkpoints;
+		uint32_t checkpointRevision = 0;
+		size_t checkpointInterval = 0;
+	};
+	typedef std::set< BBAndReg, LessBB, mem::PoolAllocator< BBAndReg > > BBlocks; // nodes from per-thread pools, see mem::Pool
+
+	enum Decision {
+		decision_unknown, // either edge can be taken
+		decision_taken,   // only the branch edge can be taken
+		decision_skipped  // only the fall-through edge can be taken
 	};
-	typedef std::set< BBAndReg, LessBB > BBlocks;
 
 	BBlocks bblocks; // basic-block nodes in the CFG
+	size_t checkpointInterval = 0; // instructions between checkpoints within BBs; zero for no checkpoints
+	Predicate predicate = nullptr; // comparison of cbr; null for unknown
+	size_t memorySampling = 0; // BB evaluations between memory-usage samples during solve; zero for no sampling
+	mem::Usage peakUsage; // largest memory usage sampled
+
+	// decide a cbr ending a BB, given its at-exit registry; decided only when both compared registers hold a single
+	// constant and the predicate is known
+	Decision decideBranch(const BBAndReg&) const;
+
+	// look up the BB containing the given address
+	const BBAndReg* findBasicBlock(const bb::Address) const;
+	// replay a BB from its closest checkpoint at or before the given instruction index, up to that index
+	bool replay(const BBAndReg&, const size_t index, Registry&, Stack&) const;
 
-	typedef std::vector< reg::Value > Values;
-	typedef std::vector< Values > Stack;
+	// sample memory usage, keeping the peak
+	void sampleMemoryUsage();
 
-	Stack stack; // stack for 'storage'
+	// compile transfer summary of a BB
+	static void compileTransfer(BBAndReg&);
+	// update registry and 'storage' stack according to a transfer summary; return false if the summary is not applicable
+	static bool applyTransfer(const Transfer&, Registry&, Stack&);
+	// check if a BB overlaps any BB in the CFG, BBs of the same start address aside
+	bool overlaps(const bb::BasicBlock&) const;
 
 public:
 	// add basic block to the CFG
 	bool addBasicBlock(bb::BasicBlock&&);
+	// add basic block past the end of all BBs in the CFG, in amortized constant time; mandates a start address at or past
+	// the end of the last BB, otherwise the BB is left intact
+	bool appendBasicBlock(bb::BasicBlock&&);
+	// move all BBs of another CFG into this one, along with their state, by relinking their nodes rather than copying;
+	// BBs past the end of all BBs in this CFG take amortized constant time each; BBs overlapping ones present are left in
+	// the other CFG; return false if any BB was left
+	bool spliceBasicBlocks(BasicControlFlowGraph&);
+	// remove basic block and its registries from the CFG
+	bool removeBasicBlock(const bb::Address);
 	// look up basic block in the CFG, mutable version
 	bb::BasicBlock* getBasicBlock(const bb::Address);
 	// look up basic block in the CFG, immutable version
 	const bb::BasicBlock* getBasicBlock(const bb::Address) const;
 
-	// set registry at BB entry in the CFG; mandates a pre-existing BB
-	bool setRegistry(const bb::Address, reg::Registry&&);
-	// compute registry at BB exit in the CFG; mandates a pre-existing BB
+	// set registry and 'storage' stack at BB entry in the CFG; mandates a pre-existing BB
+	bool setRegistry(const bb::Address, Registry&&, const Stack& = Stack());
+	// clear registries and 'storage' stacks of a BB, as if never reached; mandates a pre-existing BB
+	bool resetRegistry(const bb::Address);
+	// merge registry and 'storage' stack into those at BB entry in the CFG; mandates a pre-existing BB and matching stack heights
+	bool mergeRegistry(const bb::Address, const Registry&, const Stack&, bool& changed);
+	// compute registry and 'storage' stack at BB exit in the CFG, via the BB transfer summary, compiled anew if the BB was
+	// edited since; mandates a pre-existing BB
 	bool calcRegistry(const bb::Address);
+	// update registry and 'storage' stack according to an instruction at the given address; return false if the instruction
+	// cannot execute in the given state, e.g. it references unoccupied registers
+	static bool transfer(const isa::Instr&, const bb::Address, Registry&, Stack&);
 	// look up registries in the CFG, mutable version; returned ptr is an array, use RegOrder to index
-	reg::Registry* getRegistry(const bb::Address);
+	Registry* getRegistry(const bb::Address);
 	// look up registries the CFG, immutable version; returned ptr is an array, use RegOrder to index
-	const reg::Registry* getRegistry(const bb::Address) const;
+	const Registry* getRegistry(const bb::Address) const;
+	// look up 'storage' stacks in the CFG; returned ptr is an array, use RegOrder to index
+	const Stack* getStack(const bb::Address) const;
+	// check if registry at BB entry in the CFG was set, directly or via a merge; mandates a pre-existing BB
+	bool isReached(const bb::Address) const;
+	// set number of instructions between registry checkpoints within BBs, trading memory for query latency; zero disables
+	// checkpoints; existing checkpoints are recomputed on demand; each checkpoint holds a full copy of the registry and
+	// 'storage' stack (the latter sharing its nodes), so a BB of n instructions takes about n / interval registries more
+	// -- see memoryUsage
+	void setCheckpointInterval(const size_t);
+	// compute registry and 'storage' stack before the instruction at the given address, replaying at most one checkpoint
+	// interval of instructions; checkpoints of the containing BB get computed if missing; mandates a reached BB
+	bool getRegistryAt(const bb::Address, Registry&, Stack&);
+	// compute registry and 'storage' stack before the instruction at the given address, using only existing checkpoints;
+	// mandates a reached BB
+	bool getRegistryAt(const bb::Address, Registry&, Stack&) const;
+	// set comparison of cbr, letting the analysis prune edges of cbrs comparing constants; null for unknown, the default;
+	// takes effect on BBs (re)computed from then on
+	void setPredicate(const Predicate);
+	// get all known branch targets at BB exit, as per BB exit and its at-exit registry; edges a cbr cannot take as per the
+	// predicate are left out; mandates a pre-existing BB
+	bool getExitTargets(const bb::Address, bb::BTB&) const;
 
-	typedef BBlocks::const_iterator const_iterator;
+	// get bytes taken on the heap by the CFG -- its BBs, registries, 'storage' stacks, transfer summaries and checkpoints;
+	// its own body excluded
+	mem::Usage memoryUsage() const;
+	// set number of BB evaluations between memory-usage samples during solve, each costing a walk over the CFG; zero
+	// disables sampling, the default; resets the peak
+	void setMemorySampling(const size_t);
+	// get the largest memory usage sampled so far, by total
+	const mem::Usage& getPeakMemoryUsage() const { return peakUsage; }
+
+	// compute registries of all BBs reachable from the given BB, merging at joins, until no BB entry changes; mandates a set
+	// at-entry registry of the given BB; every exit to a target outside of the CFG, or to an unknown target (addr-invalid),
+	// is reported to callable 'outside' as (target, source) and aborts the computation if the callable returns false
+	template < typename Outside >
+	bool solve(const bb::Address, Outside&& outside);
+	// compute registries of all BBs reachable from the given BB; exits outside of the CFG are ignored
+	bool solve(const bb::Address);
+
+	typedef typename BBlocks::const_iterator const_iterator;
 	// get immutable start iterator of the CFG (first element)
 	const_iterator begin() const;
 	// get immutable end iterator of the CFG (one past the final element)
 	const_iterator end() const;
-
-	// clear the stack storage
-	void stackClear();
 };
 
-inline bool ControlFlowGraph::addBasicBlock(bb::BasicBlock&& bb)
+// CFG of the largest GPR file
+typedef BasicControlFlowGraph< reg::reg_count_max > ControlFlowGraph;
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::overlaps(const bb::BasicBlock& bb) const
 {
 	using namespace bb;
 	const Address bbAddress = bb.getStartAddress();
@@ -90,7 +226,7 @@ inline bool ControlFlowGraph::addBasicBlock(bb::BasicBlock&& bb)
 	const std::pair< const_iterator, const_iterator > range = bblocks.equal_range(bb);
 
 	// check preceding elemets for address overlaps
-	for (BBlocks::const_reverse_iterator it = std::make_reverse_iterator<const_iterator>(range.first); it != bblocks.rend(); ++it) {
+	for (typename BBlocks::const_reverse_iterator it = std::make_reverse_iterator<const_iterator>(range.first); it != bblocks.rend(); ++it) {
 		const Address presentAddr = it->getStartAddress();
 		const Interval present = { .begin = presentAddr, .end = presentAddr + Address(it->getSequence().size()) };
 
@@ -98,11 +234,11 @@ inline bool ControlFlowGraph::addBasicBlock(bb::BasicBlock&& bb)
 			break;
 
 		if (incoming.overlap(present))
-			return false;
+			return true;
 	}
 
 	// check succeeding elements for address overlaps
-	for (BBlocks::const_iterator it = range.second; it != bblocks.end(); ++it) {
+	for (typename BBlocks::const_iterator it = range.second; it != bblocks.end(); ++it) {
 		const Address presentAddr = it->getStartAddress();
 		const Interval present = { .begin = presentAddr, .end = presentAddr + Address(it->getSequence().size()) };
 
@@ -110,28 +246,87 @@ inline bool ControlFlowGraph::addBasicBlock(bb::BasicBlock&& bb)
 			break;
 
 		if (present.overlap(incoming))
+			return true;
+	}
+
+	return false;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::addBasicBlock(bb::BasicBlock&& bb)
+{
+	if (overlaps(bb))
+		return false;
+
+	return bblocks.insert(std::move(bb)).second;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::appendBasicBlock(bb::BasicBlock&& bb)
+{
+	using namespace bb;
+
+	if (!bblocks.empty()) {
+		const BBAndReg& last = *bblocks.rbegin();
+		if (uint32_t(bb.getStartAddress()) < uint32_t(last.getStartAddress()) + uint32_t(last.getSequence().size()))
 			return false;
 	}
 
-	bblocks.insert(std::move(bb));
+	bblocks.emplace_hint(bblocks.end(), std::move(bb));
 	return true;
 }
 
-inline bb::BasicBlock* ControlFlowGraph::getBasicBlock(const bb::Address start)
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::spliceBasicBlocks(BasicControlFlowGraph& oth)
+{
+	for (typename BBlocks::iterator it = oth.bblocks.begin(); it != oth.bblocks.end(); ) {
+		const typename BBlocks::iterator curr = it++;
+		const uint32_t start = curr->getStartAddress();
+
+		if (!bblocks.empty()) {
+			const BBAndReg& last = *bblocks.rbegin();
+			const uint32_t lastStart = last.getStartAddress();
+
+			// BBs not past the end take the general path; those overlapping others, same start included, stay behind
+			if (start <= lastStart || start < lastStart + uint32_t(last.getSequence().size())) {
+				if (overlaps(*curr) || bblocks.count(*curr))
+					continue;
+
+				bblocks.insert(oth.bblocks.extract(curr));
+				continue;
+			}
+		}
+
+		bblocks.insert(bblocks.end(), oth.bblocks.extract(curr));
+	}
+
+	return oth.bblocks.empty();
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::removeBasicBlock(const bb::Address start)
+{
+	return 0 != bblocks.erase(bb::BasicBlock(start));
+}
+
+template < size_t RegCount >
+inline bb::BasicBlock* BasicControlFlowGraph< RegCount >::getBasicBlock(const bb::Address start)
 {
 	// following const_cast may look like trouble but the so-obtained BB actually
 	// cannot be mutated to a dregree where it could violate the container order
-	const BBlocks::iterator it = bblocks.find(bb::BasicBlock(start));
+	const typename BBlocks::iterator it = bblocks.find(bb::BasicBlock(start));
 	return it != bblocks.end() ? const_cast< BBAndReg* >(&*it) : nullptr;
 }
 
-inline const bb::BasicBlock* ControlFlowGraph::getBasicBlock(const bb::Address start) const
+template < size_t RegCount >
+inline const bb::BasicBlock* BasicControlFlowGraph< RegCount >::getBasicBlock(const bb::Address start) const
 {
-	const BBlocks::const_iterator it = bblocks.find(bb::BasicBlock(start));
+	const typename BBlocks::const_iterator it = bblocks.find(bb::BasicBlock(start));
 	return it != bblocks.end() ? &*it : nullptr;
 }
 
-inline bool ControlFlowGraph::setRegistry(const bb::Address bbAddress, reg::Registry&& src)
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::setRegistry(const bb::Address bbAddress, Registry&& src, const Stack& stack)
 {
 	BBAndReg* const p = static_cast< BBAndReg* >(getBasicBlock(bbAddress));
 
@@ -139,10 +334,64 @@ inline bool ControlFlowGraph::setRegistry(const bb::Address bbAddress, reg::Regi
 		return false;
 
 	p->reg[order_entry] = std::move(src);
+	p->stack[order_entry] = stack;
+	p->entrySet = true;
+	p->checkpoints.clear();
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::resetRegistry(const bb::Address bbAddress)
+{
+	BBAndReg* const p = static_cast< BBAndReg* >(getBasicBlock(bbAddress));
+
+	if (!p)
+		return false;
+
+	for (size_t i = 0; i < order__count; ++i) {
+		p->reg[i] = Registry();
+		p->stack[i] = Stack();
+	}
+
+	p->entrySet = false;
+	p->checkpoints.clear();
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::mergeRegistry(const bb::Address bbAddress, const Registry& src, const Stack& stack, bool& changed)
+{
+	BBAndReg* const p = static_cast< BBAndReg* >(getBasicBlock(bbAddress));
+
+	if (!p)
+		return false;
+
+	// first state to reach a BB is taken as is
+	if (!p->entrySet) {
+		p->reg[order_entry] = src;
+		p->stack[order_entry] = stack;
+		p->entrySet = true;
+		p->checkpoints.clear();
+		changed = true;
+		return true;
+	}
+
+	if (!p->stack[order_entry].merge(stack, changed)) {
+		fprintf(stderr, "error: BB at %08x reached with mismatching storage heights %lu and %lu\n",
+			uint32_t(bbAddress), p->stack[order_entry].height(), stack.height());
+		return false;
+	}
+
+	changed |= p->reg[order_entry].merge(src);
+
+	if (changed)
+		p->checkpoints.clear();
+
 	return true;
 }
 
-inline bool ControlFlowGraph::calcRegistry(const bb::Address bbAddress)
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::calcRegistry(const bb::Address bbAddress)
 {
 	BBAndReg* const p = static_cast< BBAndReg* >(getBasicBlock(bbAddress));
 
@@ -150,117 +399,641 @@ inline bool ControlFlowGraph::calcRegistry(const bb::Address bbAddress)
 		return false;
 
 	using namespace bb;
-	using namespace isa;
 
+	if (!p->xfer.compiled || p->xfer.revision != p->getRevision())
+		compileTransfer(*p);
+
+	Registry currReg = p->reg[order_entry];
+	Stack currStack = p->stack[order_entry];
+
+	p->checkpoints.clear();
+
+	if (applyTransfer(p->xfer, currReg, currStack)) {
+		p->reg[order_exit] = std::move(currReg);
+		p->stack[order_exit] = std::move(currStack);
+		return true;
+	}
+
+	// the BB cannot execute in its at-entry state; walk its instructions to report exactly why
 	Address currAddress = bbAddress;
-	reg::Registry currReg = p->reg[0];
+	currReg = p->reg[order_entry];
+	currStack = p->stack[order_entry];
 
 	const Instructions& seq = p->getSequence();
 	for (const auto it : seq) {
-		Operand args[] = {
-			reg_invalid,
-			reg_invalid,
-			reg_invalid
-		};
+		if (!transfer(it, currAddress, currReg, currStack))
+			return false;
+		++currAddress;
+	}
+
+	p->reg[order_exit] = std::move(currReg);
+	p->stack[order_exit] = std::move(currStack);
+	return true;
+}
+
+template < size_t RegCount >
+inline void BasicControlFlowGraph< RegCount >::compileTransfer(BBAndReg& block)
+{
+	using namespace isa;
+
+	Transfer& xfer = block.xfer;
+	xfer.uses.clear();
+	xfer.steps.clear();
+	xfer.popDepth = 0;
+	xfer.revision = block.getRevision();
+	xfer.compiled = true;
+	xfer.executable = true;
+
+	// register status within the BB: untouched so far, occupied, or vacated
+	enum Status : uint8_t {
+		status_untouched,
+		status_occupied,
+		status_vacated
+	};
+
+	Status status[RegCount] = {};
+	size_t height = 0; // 'storage' height above the at-entry height; negative heights accounted in popDepth
+	size_t written[RegCount] = {}; // per register, steps emitted up to and including its last write
+	std::vector< size_t > pushes; // indices of the steps pushing above the at-entry height, bottom to top
+	std::vector< bool > folded; // per step, folded away with its matching push or pop
+
+	const auto use = [&](const Operand reg) {
+		if (reg_invalid == reg)
+			return;
+
+		if (reg >= RegCount || status_vacated == status[reg]) {
+			xfer.executable = false;
+			return;
+		}
+
+		if (status_untouched == status[reg]) {
+			status[reg] = status_occupied;
+			xfer.uses.push_back(reg);
+		}
+	};
+
+	for (const auto it : block.getSequence()) {
 		const Opcode op = it.getOpcode();
-		// get dst register
+		const Operand dst = it.getOperand(0);
+
+		// operands required occupied -- mirrors transfer()
 		switch (op) {
-		case op_li:
 		case op_push:
-		case op_pop:
 		case op_br:
+			use(dst);
+			break;
 		case op_cbr:
+			use(dst);
+			use(it.getOperand(1));
+			use(it.getOperand(2));
+			break;
 		case op_op2:
+			use(it.getOperand(1));
+			break;
 		case op_op3:
-			args[0] = it.getOperand(0);
+			use(it.getOperand(1));
+			use(it.getOperand(2));
 			break;
 		}
-		// get src0 register
+
+		if (!xfer.executable)
+			return;
+
 		switch (op) {
-		case op_cbr:
+		case op_li:
+		case op_pop:
 		case op_op2:
 		case op_op3:
-			args[1] = it.getOperand(1);
+			if (dst >= RegCount) {
+				xfer.executable = false;
+				return;
+			}
 			break;
 		}
-		// get src1 register
+
 		switch (op) {
-		case op_cbr:
+		case op_li:
+			xfer.steps.push_back(Transfer::Step{ Transfer::action_load, dst, it.getImm() });
+			status[dst] = status_occupied;
+			written[dst] = xfer.steps.size();
+			break;
+		case op_op2:
 		case op_op3:
-			args[2] = it.getOperand(2);
+			xfer.steps.push_back(Transfer::Step{ Transfer::action_clobber, dst, word_invalid });
+			status[dst] = status_occupied;
+			written[dst] = xfer.steps.size();
+			break;
+		case op_push:
+			pushes.push_back(xfer.steps.size());
+			xfer.steps.push_back(Transfer::Step{ Transfer::action_push, dst, word_invalid });
+			status[dst] = status_vacated;
+			++height;
+			break;
+		case op_pop:
+			status[dst] = status_occupied;
+			if (!height) {
+				xfer.steps.push_back(Transfer::Step{ Transfer::action_pop, dst, word_invalid });
+				written[dst] = xfer.steps.size();
+				++xfer.popDepth;
+				break;
+			}
+
+			--height;
+
+			// a pop restoring the register of its matching push, not written in between, leaves both register and
+			// 'storage' as they were before the push -- fold the pair away
+			if (dst == xfer.steps[pushes.back()].reg && written[dst] <= pushes.back()) {
+				folded.resize(xfer.steps.size());
+				folded[pushes.back()] = true;
+				pushes.pop_back();
+				break;
+			}
+
+			pushes.pop_back();
+			xfer.steps.push_back(Transfer::Step{ Transfer::action_pop, dst, word_invalid });
+			written[dst] = xfer.steps.size();
 			break;
 		}
-		// verify operand0 validity if branch or push op
-		if (reg_invalid != args[0] && (isBranch(op) || op_push == op) && !currReg.occupied(args[0])) {
-			fprintf(stderr, "error: instr at %p references an unoccupied 1st-operand register %04x\n", currAddress, args[0]);
-			return false;
+	}
+
+	if (!folded.empty()) {
+		size_t kept = 0;
+		for (size_t i = 0; i < xfer.steps.size(); ++i) {
+			if (i >= folded.size() || !folded[i])
+				xfer.steps[kept++] = xfer.steps[i];
 		}
-		// verify operand1 validity if applicable
-		if (reg_invalid != args[1] && !currReg.occupied(args[1])) {
-			fprintf(stderr, "error: instr at %p references an unoccupied 2nd-operand register %04x\n", currAddress, args[1]);
-			return false;
+		xfer.steps.erase(xfer.steps.begin() + kept, xfer.steps.end());
+	}
+
+	// drop steps whose register gets overwritten before it is read; only pushes read registers
+	bool dead[RegCount] = {};
+	size_t kept = xfer.steps.size();
+
+	for (size_t i = xfer.steps.size(); i-- > 0; ) {
+		const Transfer::Step step = xfer.steps[i];
+
+		switch (step.action) {
+		case Transfer::action_load:
+		case Transfer::action_clobber:
+			if (dead[step.reg])
+				continue;
+			dead[step.reg] = true;
+			break;
+		case Transfer::action_pop:
+			dead[step.reg] = true;
+			break;
+		case Transfer::action_push:
+			dead[step.reg] = false;
+			break;
 		}
-		// verify operand2 validity if applicable
-		if (reg_invalid != args[2] && !currReg.occupied(args[2])) {
-			fprintf(stderr, "error: instr at %p references an unoccupied 3rd-operand register %04x\n", currAddress, args[2]);
+
+		xfer.steps[--kept] = step;
+	}
+
+	xfer.steps.erase(xfer.steps.begin(), xfer.steps.begin() + kept);
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::applyTransfer(const Transfer& xfer, Registry& reg, Stack& stack)
+{
+	if (!xfer.executable || stack.height() < xfer.popDepth)
+		return false;
+
+	for (const auto it : xfer.uses) {
+		if (!reg.occupied(it))
 			return false;
-		}
-		// update current registry according to op
-		Values values;
-		switch (op) {
-		case op_li:
-			currReg.addValue(it.getOperand(0), it.getImm());
+	}
+
+	storage::Values values;
+	for (const auto it : xfer.steps) {
+		switch (it.action) {
+		case Transfer::action_load:
+			reg.vacate(it.reg);
+			reg.addValue(it.reg, it.imm);
 			break;
-		case op_push:
-			for (const auto iv : currReg.getValues(it.getOperand(0)))
+		case Transfer::action_clobber:
+			reg.vacate(it.reg);
+			reg.addUnknown(it.reg);
+			break;
+		case Transfer::action_push:
+			values.clear();
+			for (const auto iv : reg.getValues(it.reg))
 				values.push_back(iv.second);
-			currReg.vacate(it.getOperand(0));
-			stack.push_back(std::move(values));
+			reg.vacate(it.reg);
+			stack = stack.push(std::move(values));
 			break;
-		case op_pop:
-			assert(!stack.empty());
-			currReg.vacate(it.getOperand(0));
-			for (const auto iv : stack.back())
-				currReg.addValue(it.getOperand(0), iv);
-			stack.pop_back();
+		case Transfer::action_pop:
+			reg.vacate(it.reg);
+			for (const auto iv : stack.peek())
+				reg.addValue(it.reg, iv);
+			stack = stack.pop();
 			break;
 		}
-		++currAddress;
 	}
 
-	p->reg[order_exit] = std::move(currReg);
 	return true;
 }
 
-inline reg::Registry* ControlFlowGraph::getRegistry(const bb::Address start)
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::transfer(const isa::Instr& instr, const bb::Address address, Registry& reg, Stack& stack)
+{
+	using namespace isa;
+
+	Operand args[] = {
+		reg_invalid,
+		reg_invalid,
+		reg_invalid
+	};
+	const Opcode op = instr.getOpcode();
+	// get dst register
+	switch (op) {
+	case op_li:
+	case op_push:
+	case op_pop:
+	case op_br:
+	case op_cbr:
+	case op_op2:
+	case op_op3:
+		args[0] = instr.getOperand(0);
+		break;
+	}
+	// get src0 register
+	switch (op) {
+	case op_cbr:
+	case op_op2:
+	case op_op3:
+		args[1] = instr.getOperand(1);
+		break;
+	}
+	// get src1 register
+	switch (op) {
+	case op_cbr:
+	case op_op3:
+		args[2] = instr.getOperand(2);
+		break;
+	}
+	// verify operands fit the GPR file
+	if ((reg_invalid != args[0] && args[0] >= RegCount) ||
+		(reg_invalid != args[1] && args[1] >= RegCount) ||
+		(reg_invalid != args[2] && args[2] >= RegCount)) {
+		fprintf(stderr, "error: instr at %p references a register outside of a %lu-register file\n", address, RegCount);
+		return false;
+	}
+	// verify operand0 validity if branch or push op
+	if (reg_invalid != args[0] && (isBranch(op) || op_push == op) && !reg.occupied(args[0])) {
+		fprintf(stderr, "error: instr at %p references an unoccupied 1st-operand register %04x\n", address, args[0]);
+		return false;
+	}
+	// verify operand1 validity if applicable
+	if (reg_invalid != args[1] && !reg.occupied(args[1])) {
+		fprintf(stderr, "error: instr at %p references an unoccupied 2nd-operand register %04x\n", address, args[1]);
+		return false;
+	}
+	// verify operand2 validity if applicable
+	if (reg_invalid != args[2] && !reg.occupied(args[2])) {
+		fprintf(stderr, "error: instr at %p references an unoccupied 3rd-operand register %04x\n", address, args[2]);
+		return false;
+	}
+	// verify storage is non-empty if pop op
+	if (op_pop == op && stack.empty()) {
+		fprintf(stderr, "error: instr at %p pops from an empty storage\n", address);
+		return false;
+	}
+	// update current registry according to op
+	storage::Values values;
+	switch (op) {
+	case op_li:
+		reg.vacate(instr.getOperand(0));
+		reg.addValue(instr.getOperand(0), instr.getImm());
+		break;
+	case op_push:
+		for (const auto iv : reg.getValues(instr.getOperand(0)))
+			values.push_back(iv.second);
+		reg.vacate(instr.getOperand(0));
+		stack = stack.push(std::move(values));
+		break;
+	case op_pop:
+		reg.vacate(instr.getOperand(0));
+		for (const auto iv : stack.peek())
+			reg.addValue(instr.getOperand(0), iv);
+		stack = stack.pop();
+		break;
+	case op_op2:
+	case op_op3:
+		reg.vacate(instr.getOperand(0));
+		reg.addUnknown(instr.getOperand(0));
+		break;
+	}
+
+	return true;
+}
+
+template < size_t RegCount >
+inline typename BasicControlFlowGraph< RegCount >::Registry* BasicControlFlowGraph< RegCount >::getRegistry(const bb::Address start)
 {
 	// following const_cast may look like trouble but the so-obtained BB actually
 	// cannot be mutated to a dregree where it could violate the container order
-	const BBlocks::iterator it = bblocks.find(bb::BasicBlock(start));
-	return it != bblocks.end() ? const_cast< reg::Registry* >(it->reg) : nullptr;
+	const typename BBlocks::iterator it = bblocks.find(bb::BasicBlock(start));
+	return it != bblocks.end() ? const_cast< Registry* >(it->reg) : nullptr;
 }
 
-inline const reg::Registry* ControlFlowGraph::getRegistry(const bb::Address start) const
+template < size_t RegCount >
+inline const typename BasicControlFlowGraph< RegCount >::Registry* BasicControlFlowGraph< RegCount >::getRegistry(const bb::Address start) const
 {
-	const BBlocks::const_iterator it = bblocks.find(bb::BasicBlock(start));
+	const typename BBlocks::const_iterator it = bblocks.find(bb::BasicBlock(start));
 	return it != bblocks.end() ? it->reg : nullptr;
 }
 
-inline ControlFlowGraph::const_iterator ControlFlowGraph::begin() const
+template < size_t RegCount >
+inline const typename BasicControlFlowGraph< RegCount >::Stack* BasicControlFlowGraph< RegCount >::getStack(const bb::Address start) const
+{
+	const typename BBlocks::const_iterator it = bblocks.find(bb::BasicBlock(start));
+	return it != bblocks.end() ? it->stack : nullptr;
+}
+
+template < size_t RegCount >
+inline void BasicControlFlowGraph< RegCount >::setCheckpointInterval(const size_t interval)
+{
+	checkpointInterval = interval;
+}
+
+template < size_t RegCount >
+inline mem::Usage BasicControlFlowGraph< RegCount >::memoryUsage() const
+{
+	mem::Usage usage;
+	std::unordered_set< const void* > seen; // 'storage' nodes, shared among stacks
+
+	usage.overhead += bblocks.size() * (sizeof(BBAndReg) + mem::tree_node_overhead);
+
+	for (const auto& it : bblocks) {
+		usage += it.bb::BasicBlock::memoryUsage();
+
+		for (size_t i = 0; i < order__count; ++i) {
+			usage += it.reg[i].memoryUsage();
+			it.stack[i].memoryUsage(usage, seen);
+		}
+
+		mem::addVector(it.xfer.uses, usage.summaries, usage);
+		mem::addVector(it.xfer.steps, usage.summaries, usage);
+		mem::addVector(it.checkpoints, usage.overhead, usage);
+
+		for (const auto& jt : it.checkpoints) {
+			usage += jt.first.memoryUsage();
+			jt.second.memoryUsage(usage, seen);
+		}
+	}
+
+	return usage;
+}
+
+template < size_t RegCount >
+inline void BasicControlFlowGraph< RegCount >::setMemorySampling(const size_t interval)
+{
+	memorySampling = interval;
+	peakUsage = mem::Usage();
+}
+
+template < size_t RegCount >
+inline void BasicControlFlowGraph< RegCount >::sampleMemoryUsage()
+{
+	const mem::Usage usage = memoryUsage();
+	if (usage.total() > peakUsage.total())
+		peakUsage = usage;
+}
+
+template < size_t RegCount >
+inline void BasicControlFlowGraph< RegCount >::setPredicate(const Predicate pred)
+{
+	predicate = pred;
+}
+
+template < size_t RegCount >
+inline typename BasicControlFlowGraph< RegCount >::Decision BasicControlFlowGraph< RegCount >::decideBranch(const BBAndReg& block) const
+{
+	using namespace bb;
+	using namespace isa;
+
+	const Instructions& seq = block.getSequence();
+	if (!predicate || seq.empty() || op_cbr != seq.back().getOpcode())
+		return decision_unknown;
+
+	const reg::ValueRange lhs = block.reg[order_exit].getValues(seq.back().getOperand(1));
+	const reg::ValueRange rhs = block.reg[order_exit].getValues(seq.back().getOperand(2));
+
+	if (lhs.first == lhs.second || std::next(lhs.first) != lhs.second || !isWordValid(lhs.first->second) ||
+		rhs.first == rhs.second || std::next(rhs.first) != rhs.second || !isWordValid(rhs.first->second))
+		return decision_unknown;
+
+	return predicate(lhs.first->second, rhs.first->second) ? decision_taken : decision_skipped;
+}
+
+template < size_t RegCount >
+inline const typename BasicControlFlowGraph< RegCount >::BBAndReg* BasicControlFlowGraph< RegCount >::findBasicBlock(const bb::Address address) const
+{
+	// last BB starting at or before the address
+	typename BBlocks::const_iterator it = bblocks.upper_bound(bb::BasicBlock(address));
+
+	if (it == bblocks.begin())
+		return nullptr;
+
+	--it;
+	return address - it->getStartAddress() < it->getSequence().size() ? &*it : nullptr;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::replay(const BBAndReg& block, const size_t index, Registry& reg, Stack& stack) const
+{
+	using namespace bb;
+
+	const bool valid = block.checkpointInterval && block.checkpointRevision == block.getRevision();
+	const size_t k = valid ? std::min(index / block.checkpointInterval, block.checkpoints.size()) : 0;
+	size_t i = 0;
+
+	if (k) {
+		reg = block.checkpoints[k - 1].first;
+		stack = block.checkpoints[k - 1].second;
+		i = k * block.checkpointInterval;
+	}
+	else {
+		reg = block.reg[order_entry];
+		stack = block.stack[order_entry];
+	}
+
+	const Instructions& seq = block.getSequence();
+	for (; i < index; ++i) {
+		if (!transfer(seq[i], block.getStartAddress() + Address(i), reg, stack))
+			return false;
+	}
+
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::getRegistryAt(const bb::Address address, Registry& reg, Stack& stack)
+{
+	BBAndReg* const p = const_cast< BBAndReg* >(findBasicBlock(address));
+
+	if (!p || !p->entrySet)
+		return false;
+
+	using namespace bb;
+
+	// recompute stale checkpoints in a single walk over the BB
+	if (checkpointInterval && (p->checkpointInterval != checkpointInterval || p->checkpointRevision != p->getRevision() ||
+		(p->checkpoints.empty() && p->getSequence().size() > checkpointInterval))) {
+
+		p->checkpoints.clear();
+		p->checkpointInterval = checkpointInterval;
+		p->checkpointRevision = p->getRevision();
+
+		Registry currReg = p->reg[order_entry];
+		Stack currStack = p->stack[order_entry];
+
+		const Instructions& seq = p->getSequence();
+		for (size_t i = 0; i < seq.size(); ++i) {
+			if (i && 0 == i % checkpointInterval)
+				p->checkpoints.push_back(std::make_pair(currReg, currStack));
+
+			if (!transfer(seq[i], p->getStartAddress() + Address(i), currReg, currStack))
+				break;
+		}
+	}
+
+	return replay(*p, address - p->getStartAddress(), reg, stack);
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::getRegistryAt(const bb::Address address, Registry& reg, Stack& stack) const
+{
+	const BBAndReg* const p = findBasicBlock(address);
+
+	if (!p || !p->entrySet)
+		return false;
+
+	return replay(*p, address - p->getStartAddress(), reg, stack);
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::isReached(const bb::Address start) const
+{
+	const typename BBlocks::const_iterator it = bblocks.find(bb::BasicBlock(start));
+	return it != bblocks.end() && it->entrySet;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::getExitTargets(const bb::Address start, bb::BTB& targets) const
+{
+	const typename BBlocks::const_iterator it = bblocks.find(bb::BasicBlock(start));
+
+	if (it == bblocks.end())
+		return false;
+
+	using namespace bb;
+	using namespace isa;
+
+	targets.clear();
+
+	const Decision decision = decideBranch(*it);
+
+	// static targets, e.g. falling through to the next BB
+	for (size_t i = 0; decision_taken != decision && isAddrValid(it->getExitTargetAddress(i)); ++i)
+		targets.push_back(it->getExitTargetAddress(i));
+
+	// dynamic targets -- known values of the branch-target register; unknowns cannot be followed
+	const Instructions& seq = it->getSequence();
+	if (seq.empty() || !isBranch(seq.back().getOpcode()) || decision_skipped == decision)
+		return true;
+
+	for (const auto iv : it->reg[order_exit].getValues(seq.back().getOperand(0))) {
+		if (isAddrValid(iv.second))
+			targets.push_back(iv.second);
+	}
+
+	return true;
+}
+
+template < size_t RegCount >
+inline typename BasicControlFlowGraph< RegCount >::const_iterator BasicControlFlowGraph< RegCount >::begin() const
 {
 	return bblocks.begin();
 }
 
-inline ControlFlowGraph::const_iterator ControlFlowGraph::end() const
+template < size_t RegCount >
+inline typename BasicControlFlowGraph< RegCount >::const_iterator BasicControlFlowGraph< RegCount >::end() const
 {
 	return bblocks.end();
 }
 
-inline void ControlFlowGraph::stackClear()
+template < size_t RegCount >
+template < typename Outside >
+inline bool BasicControlFlowGraph< RegCount >::solve(const bb::Address entry, Outside&& outside)
+{
+	using namespace bb;
+	using namespace isa;
+
+	std::vector< Address > work(1, entry);
+	BTB targets;
+	size_t evaluations = 0;
+
+	while (!work.empty()) {
+		const Address start = work.back();
+		work.pop_back();
+
+		if (!calcRegistry(start))
+			return false;
+
+		if (memorySampling && 0 == ++evaluations % memorySampling)
+			sampleMemoryUsage();
+
+		const BBAndReg* const p = static_cast< const BBAndReg* >(getBasicBlock(start));
+		getExitTargets(start, targets);
+
+		for (const auto target : targets) {
+			bool changed;
+
+			if (!getBasicBlock(target)) {
+				if (!outside(target, start))
+					return false;
+				continue;
+			}
+
+			if (!mergeRegistry(target, p->reg[order_exit], p->stack[order_exit], changed))
+				return false;
+
+			if (changed)
+				work.push_back(target);
+		}
+
+		// branching to unknown targets exits the CFG as well
+		const Instr last = p->getSequence().back();
+		if (isBranch(last.getOpcode()) && decision_skipped != decideBranch(*p)) {
+			for (const auto iv : p->reg[order_exit].getValues(last.getOperand(0))) {
+				if (!isAddrValid(iv.second)) {
+					if (!outside(addr_invalid, start))
+						return false;
+					break;
+				}
+			}
+		}
+	}
+
+	if (memorySampling)
+		sampleMemoryUsage();
+
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicControlFlowGraph< RegCount >::solve(const bb::Address entry)
 {
-	stack.clear();
+	return solve(entry, [](const bb::Address, const bb::Address) { return true; });
 }
 
+extern template class BasicControlFlowGraph< reg::reg_count_16 >;
+extern template class BasicControlFlowGraph< reg::reg_count_32 >;
+extern template class BasicControlFlowGraph< reg::reg_count_64 >;
+extern template class BasicControlFlowGraph< reg::reg_count_max >;
+
 } // namespace cfg
 
 #endif // __cfg_h
@@ -0,0 +1,406 @@
+#if !defined(__conv_h)
+#define __conv_h
+
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <set>
+#include <vector>
+#include "isa.h"
+#include "bb.h"
+#include "reg.h"
+#include "cfg.h"
+#include "opt.h"
+
+// Calling-convention inference -- recognise functions in a solved CFG by their calls, i.e. branches whose link register
+// holds the return address, then their prologue saves, epilogue restores and returns, and infer which registers each
+// function effectively preserves and clobbers
+
+namespace conv {
+
+// save/restore pair -- a register pushed in a function prologue and popped back in the epilogue of every return
+struct Spill {
+	reg::Register reg = isa::reg_invalid;
+	bb::Address push = bb::addr_invalid; // address of the prologue push
+	std::vector< bb::Address > pops; // addresses of the epilogue pops, one per return
+	bool used = false; // register occupied before some epilogue pop, i.e. actually reused by the function or its callees
+};
+
+struct Function {
+	bb::Address entry = bb::addr_invalid;
+	reg::Register link = isa::reg_invalid; // register holding the return address at entry
+	std::vector< bb::Address > callSites; // BBs calling the function
+	std::vector< bb::Address > body; // BBs of the function proper, callees excluded, ascending
+	std::vector< bb::Address > returns; // BBs returning from the function, ascending
+	std::vector< std::pair< bb::Address, bb::Address > > edges; // edges within the body, calls stepping over to their return addresses
+	std::vector< Spill > spills; // save/restore pairs, in prologue order
+	std::vector< reg::Register > preserved; // registers occupied at entry and holding their entry values at every return, unknowns included
+	std::vector< reg::Register > clobbered; // registers not known to hold their entry values at some return
+};
+
+typedef std::vector< Function > Functions;
+
+// spill a de-spilling pass may target, in order of yield
+struct Candidate {
+	size_t function; // index of the function
+	size_t spill; // index of the save/restore pair within the function
+	size_t yield; // spill and restore instructions executed across the known call sites
+};
+
+namespace detail {
+
+// values of a register, as a sorted set of raw words, reserved bit included
+template < size_t RegCount >
+inline void getValues(const reg::BasicRegistry< RegCount >& registry, const reg::Register reg, std::vector< uint32_t >& values)
+{
+	values.clear();
+	for (const auto it : registry.getValues(reg))
+		values.push_back(uint32_t(it.second) | uint32_t(it.second.reserved) << 31);
+
+	std::sort(values.begin(), values.end());
+}
+
+// get index of the last instruction in a sequence that is not a nop, before the given index
+inline size_t skipNopsBackward(const bb::Instructions& seq, size_t index)
+{
+	while (index > 0 && isa::op_nop == seq[index - 1].getOpcode())
+		--index;
+	return index;
+}
+
+} // namespace detail
+
+// recognise the functions called within a solved CFG, and the one at the given program entry, if any, whose link
+// register is given by the caller; return false on an inconsistent CFG
+template < size_t RegCount >
+inline bool recognise(const cfg::BasicControlFlowGraph< RegCount >& graph, Functions& functions,
+	const bb::Address programEntry = bb::addr_invalid, const reg::Register programLink = reg::Register(isa::reg_invalid))
+{
+	using namespace bb;
+	using namespace isa;
+	using reg::Register;
+
+	typedef cfg::BasicControlFlowGraph< RegCount > ControlFlowGraph;
+	typedef typename ControlFlowGraph::Registry Registry;
+	typedef typename ControlFlowGraph::Stack Stack;
+
+	functions.clear();
+
+	std::map< Address, size_t > index; // function index by entry
+	std::map< Address, Address > calls; // return address by call site
+	std::map< Address, std::vector< Address > > calleesOf; // entries of called functions by call site; addr-invalid for unknown ones
+
+	const auto addFunction = [&](const Address entry, const Register link) -> Function& {
+		const std::pair< std::map< Address, size_t >::iterator, bool > res = index.insert(std::make_pair(entry, functions.size()));
+		if (res.second) {
+			functions.push_back(Function());
+			functions.back().entry = entry;
+			functions.back().link = link;
+		}
+		return functions[res.first->second];
+	};
+
+	if (isAddrValid(programEntry) && graph.isReached(programEntry) && programLink < RegCount)
+		addFunction(programEntry, programLink);
+
+	// calls -- unconditional branches with some register holding just the address past the branch, i.e. a link
+	for (const auto& it : graph) {
+		const Address start = it.getStartAddress();
+		const Instructions& seq = it.getSequence();
+
+		if (!graph.isReached(start) || op_br != seq.back().getOpcode())
+			continue;
+
+		const Address ret = start + Address(seq.size());
+		const Register target = seq.back().getOperand(0);
+		const Registry& exit = graph.getRegistry(start)[cfg::order_exit];
+		Register link = reg_invalid;
+
+		for (Register r = 0; r < RegCount && reg_invalid == link; ++r) {
+			const reg::ValueRange range = exit.getValues(r);
+			if (r != target && range.first != range.second && std::next(range.first) == range.second &&
+				isWordValid(range.first->second) && uint32_t(range.first->second) == uint32_t(ret))
+				link = r;
+		}
+
+		if (reg_invalid == link || !graph.getBasicBlock(ret))
+			continue;
+
+		calls.insert(std::make_pair(start, ret));
+		std::vector< Address >& callees = calleesOf[start];
+
+		for (const auto iv : exit.getValues(target)) {
+			if (isAddrValid(iv.second) && graph.isReached(iv.second)) {
+				addFunction(iv.second, link).callSites.push_back(start);
+				callees.push_back(iv.second);
+			}
+			else
+				callees.push_back(addr_invalid);
+		}
+	}
+
+	std::vector< uint32_t > entryValues;
+	std::vector< uint32_t > exitValues;
+	BTB targets;
+
+	for (auto& fn : functions) {
+		const Registry& entryReg = graph.getRegistry(fn.entry)[cfg::order_entry];
+		const size_t entryHeight = graph.getStack(fn.entry)[cfg::order_entry].height();
+		detail::getValues(entryReg, fn.link, entryValues);
+
+		// body -- BBs reachable from the entry, stepping over calls to their return addresses, and stopping at returns,
+		// i.e. branches to the link register holding nothing but the values it held at entry
+		std::set< Address > body;
+		std::vector< Address > work(1, fn.entry);
+		body.insert(fn.entry);
+
+		while (!work.empty()) {
+			const Address curr = work.back();
+			work.pop_back();
+
+			const Instructions& seq = graph.getBasicBlock(curr)->getSequence();
+
+			if (op_br == seq.back().getOpcode() && fn.link == seq.back().getOperand(0)) {
+				detail::getValues(graph.getRegistry(curr)[cfg::order_exit], fn.link, exitValues);
+				if (!exitValues.empty() && std::includes(entryValues.begin(), entryValues.end(), exitValues.begin(), exitValues.end())) {
+					fn.returns.push_back(curr);
+					continue;
+				}
+			}
+
+			const std::map< Address, Address >::const_iterator call = calls.find(curr);
+			if (call != calls.end())
+				targets.assign(1, call->second);
+			else if (!graph.getExitTargets(curr, targets))
+				return false;
+
+			for (const auto target : targets) {
+				if (!graph.getBasicBlock(target) || !graph.isReached(target))
+					continue;
+
+				fn.edges.push_back(std::make_pair(curr, target));
+				if (body.insert(target).second)
+					work.push_back(target);
+			}
+		}
+
+		fn.body.assign(body.begin(), body.end());
+		std::sort(fn.returns.begin(), fn.returns.end(), [](const Address lhs, const Address rhs) { return uint32_t(lhs) < uint32_t(rhs); });
+
+		if (fn.returns.empty())
+			continue;
+
+		// prologue -- leading pushes of the entry BB
+		const Instructions& entrySeq = graph.getBasicBlock(fn.entry)->getSequence();
+		for (size_t i = 0; i < entrySeq.size(); ++i) {
+			const Opcode op = entrySeq[i].getOpcode();
+			if (op_nop == op)
+				continue;
+			if (op_push != op)
+				break;
+
+			Spill spill;
+			spill.reg = entrySeq[i].getOperand(0);
+			spill.push = fn.entry + Address(i);
+			fn.spills.push_back(spill);
+		}
+
+		// epilogues -- trailing pops before each return, mirroring the prologue, the last pop restoring the first push,
+		// each at the 'storage' height its push left behind
+		size_t matched = fn.spills.size();
+
+		for (const auto ret : fn.returns) {
+			const Instructions& seq = graph.getBasicBlock(ret)->getSequence();
+			size_t pos = seq.size() - 1;
+			size_t count = 0;
+
+			while (count < matched) {
+				pos = detail::skipNopsBackward(seq, pos);
+				if (0 == pos || op_pop != seq[pos - 1].getOpcode())
+					break;
+
+				Spill& spill = fn.spills[count];
+				const Address addr = ret + Address(pos - 1);
+				Registry reg;
+				Stack stack;
+
+				if (spill.reg != seq[pos - 1].getOperand(0) || !graph.getRegistryAt(addr, reg, stack) ||
+					stack.height() != entryHeight + count + 1)
+					break;
+
+				spill.pops.push_back(addr);
+				spill.used = spill.used || reg.occupied(spill.reg);
+				--pos;
+				++count;
+			}
+
+			matched = std::min(matched, count);
+		}
+
+		// only the outermost pairs restored at every return count; the rest are not save/restore pairs
+		fn.spills.erase(fn.spills.begin() + matched, fn.spills.end());
+	}
+
+	// conventions, callees before their callers, so that calls get stepped over as per the conventions of their callees
+	std::vector< uint8_t > visited(functions.size(), 0);
+	std::vector< uint8_t > done(functions.size(), 0);
+
+	const auto infer = [&](const size_t fi) {
+		Function& fn = functions[fi];
+		const Registry& entryReg = graph.getRegistry(fn.entry)[cfg::order_entry];
+
+		// track entry values as tokens -- must-values outside the 31-bit word range, so that unknowns held at entry
+		// and at a return can be told apart from unknowns produced in between
+		const auto token = [](const Register r) -> uint32_t { return 1U << 31 | r; };
+
+		typedef opt::detail::MustState< RegCount > State;
+		std::map< Address, State > states;
+		State atReturn;
+		bool consistent = true;
+
+		State& entry = states[fn.entry];
+		for (Register r = 0; r < RegCount; ++r)
+			entry.reg[r] = token(r);
+		entry.set = true;
+
+		std::vector< Address > work(1, fn.entry);
+		while (!work.empty() && consistent) {
+			const Address curr = work.back();
+			work.pop_back();
+
+			State state = states[curr];
+			for (const auto it : graph.getBasicBlock(curr)->getSequence())
+				opt::detail::transferMust(it, state);
+
+			bool changed = false;
+			if (std::binary_search(fn.returns.begin(), fn.returns.end(), curr,
+				[](const Address lhs, const Address rhs) { return uint32_t(lhs) < uint32_t(rhs); })) {
+				consistent = opt::detail::meetMust(atReturn, state, changed);
+				continue;
+			}
+
+			// step over calls, keeping only what every callee preserves; callees yet to be inferred, i.e. recursive
+			// ones, and unknown callees preserve nothing
+			const std::map< Address, Address >::const_iterator call = calls.find(curr);
+			if (call != calls.end()) {
+				for (const auto callee : calleesOf[curr]) {
+					const std::map< Address, size_t >::const_iterator ci = index.find(callee);
+					const Function* const fc = ci != index.end() && done[ci->second] ? &functions[ci->second] : nullptr;
+
+					for (Register r = 0; r < RegCount; ++r) {
+						if (!fc || !std::binary_search(fc->preserved.begin(), fc->preserved.end(), r))
+							state.reg[r] = opt::detail::must_none;
+					}
+				}
+
+				std::fill(state.stack.begin(), state.stack.end(), opt::detail::must_none);
+				targets.assign(1, call->second);
+			}
+			else if (!graph.getExitTargets(curr, targets))
+				return false;
+
+			for (const auto target : targets) {
+				if (!std::binary_search(fn.body.begin(), fn.body.end(), target,
+					[](const Address lhs, const Address rhs) { return uint32_t(lhs) < uint32_t(rhs); }))
+					continue;
+
+				changed = false;
+				consistent = opt::detail::meetMust(states[target], state, changed) && consistent;
+				if (changed)
+					work.push_back(target);
+			}
+		}
+
+		// preserved registers -- occupied at entry, and holding their entry values at every return, as tracked or as
+		// per the values at entry and at every return, provided these are all known; clobbered ones -- the rest of the
+		// registers occupied at some return
+		for (Register r = 0; r < RegCount; ++r) {
+			detail::getValues(entryReg, r, entryValues);
+			const bool kept = consistent && atReturn.set && token(r) == atReturn.reg[r];
+			const bool unknown = entryValues.end() != std::find_if(entryValues.begin(), entryValues.end(),
+				[](const uint32_t value) { return 0 != value >> 31; });
+			bool same = true;
+
+			for (const auto ret : fn.returns) {
+				detail::getValues(graph.getRegistry(ret)[cfg::order_exit], r, exitValues);
+				same = same && entryValues == exitValues;
+			}
+
+			if (same && (kept || !unknown)) {
+				if (!entryValues.empty() && !fn.returns.empty())
+					fn.preserved.push_back(r);
+			}
+			else
+				fn.clobbered.push_back(r);
+		}
+
+		done[fi] = 1;
+		return true;
+	};
+
+	// depth-first over the call graph, with an explicit stack so that deep call chains cannot overflow the native one;
+	// each function gets pushed again below its callees, and inferred once popped the second time
+	std::vector< std::pair< size_t, bool > > work; // function index, and whether its callees got pushed
+
+	for (size_t i = 0; i < functions.size(); ++i) {
+		if (visited[i])
+			continue;
+
+		work.push_back(std::make_pair(i, false));
+		while (!work.empty()) {
+			const size_t fi = work.back().first;
+			const bool expanded = work.back().second;
+			work.pop_back();
+
+			if (expanded) {
+				if (!infer(fi))
+					return false;
+				continue;
+			}
+
+			if (visited[fi])
+				continue;
+
+			visited[fi] = 1;
+			work.push_back(std::make_pair(fi, true));
+
+			for (const auto body : functions[fi].body) {
+				const std::map< Address, std::vector< Address > >::const_iterator it = calleesOf.find(body);
+				if (it == calleesOf.end())
+					continue;
+
+				for (const auto callee : it->second) {
+					const std::map< Address, size_t >::const_iterator ci = index.find(callee);
+					if (ci != index.end() && !visited[ci->second])
+						work.push_back(std::make_pair(ci->second, false));
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// rank the save/restore pairs of recognised functions, the unused ones first, as removable outright, then by yield
+inline void rankSpills(const Functions& functions, std::vector< Candidate >& candidates)
+{
+	candidates.clear();
+
+	for (size_t i = 0; i < functions.size(); ++i) {
+		for (size_t j = 0; j < functions[i].spills.size(); ++j) {
+			const Candidate candidate = { i, j, 2 * std::max(functions[i].callSites.size(), size_t(1)) };
+			candidates.push_back(candidate);
+		}
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(), [&](const Candidate& lhs, const Candidate& rhs) -> bool {
+		const bool lused = functions[lhs.function].spills[lhs.spill].used;
+		const bool rused = functions[rhs.function].spills[rhs.spill].used;
+		return lused != rused ? !lused : lhs.yield > rhs.yield;
+	});
+}
+
+} // namespace conv
+
+#endif // __conv_h
@@ -0,0 +1,161 @@
+#if !defined(__csr_h)
+#define __csr_h
+
+#include <stdint.h>
+#include <assert.h>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "isa.h"
+#include "bb.h"
+#include "cfg.h"
+
+// Frozen CFG -- a read-only form of a finished CFG, laid out for sequential access: all instructions in one array, edges
+// and registry values in compressed sparse rows (CSR), and the rest of per-BB state in parallel arrays, all addressed by
+// dense BB ids in address order
+
+namespace csr {
+
+// dense BB id
+typedef uint32_t BlockId;
+
+constexpr BlockId block_invalid = BlockId(-1);
+
+// registry value of a register; unknowns are word-invalid
+typedef std::pair< reg::Register, reg::Value > RegValue;
+
+template < size_t RegCount >
+class BasicFrozenGraph {
+public:
+	typedef cfg::BasicControlFlowGraph< RegCount > ControlFlowGraph;
+	typedef typename ControlFlowGraph::Registry Registry;
+	typedef typename ControlFlowGraph::Stack Stack;
+
+private:
+	bb::Instructions instr; // instructions of all BBs, BB after BB
+	std::vector< uint32_t > instrOffset; // per BB, index of its first instruction; one extra entry for the end
+	std::vector< bb::Address > start; // per BB, start address
+	std::vector< uint32_t > succOffset; // per BB, index of its first successor; one extra entry for the end
+	std::vector< BlockId > succ; // successors of all BBs, BB after BB
+	std::vector< uint32_t > predOffset; // per BB, index of its first predecessor; one extra entry for the end
+	std::vector< BlockId > pred; // predecessors of all BBs, BB after BB
+	std::vector< uint32_t > valueOffset[cfg::order__count]; // per BB, index of its first registry value; one extra entry for the end
+	std::vector< RegValue > value[cfg::order__count]; // registry values of all BBs, BB after BB, in register order
+	std::vector< Stack > stack[cfg::order__count]; // per BB, 'storage' stacks
+	std::vector< bool > reached; // per BB, at-entry state set
+
+public:
+	// freeze a CFG; successors are the known exit targets within the CFG
+	explicit BasicFrozenGraph(const ControlFlowGraph&);
+
+	// get number of BBs
+	size_t getBlockCount() const { return start.size(); }
+	// look up BB by start address; return block-invalid if none
+	BlockId findBlock(const bb::Address) const;
+	// get start address of a BB
+	bb::Address getStartAddress(const BlockId id) const { return start[id]; }
+	// get instructions of a BB, as an [begin, end) range
+	const isa::Instr* beginInstr(const BlockId id) const { return instr.data() + instrOffset[id]; }
+	const isa::Instr* endInstr(const BlockId id) const { return instr.data() + instrOffset[id + 1]; }
+	// get successors of a BB, as an [begin, end) range
+	const BlockId* beginSucc(const BlockId id) const { return succ.data() + succOffset[id]; }
+	const BlockId* endSucc(const BlockId id) const { return succ.data() + succOffset[id + 1]; }
+	// get predecessors of a BB, as an [begin, end) range
+	const BlockId* beginPred(const BlockId id) const { return pred.data() + predOffset[id]; }
+	const BlockId* endPred(const BlockId id) const { return pred.data() + predOffset[id + 1]; }
+	// get registry values of a BB, in register order, as an [begin, end) range
+	const RegValue* beginValues(const BlockId id, const cfg::RegOrder order) const { return value[order].data() + valueOffset[order][id]; }
+	const RegValue* endValues(const BlockId id, const cfg::RegOrder order) const { return value[order].data() + valueOffset[order][id + 1]; }
+	// get values of a register of a BB, as an [begin, end) range; empty if the register is vacant
+	std::pair< const RegValue*, const RegValue* > getValues(const BlockId, const cfg::RegOrder, const reg::Register) const;
+	// get 'storage' stack of a BB
+	const Stack& getStack(const BlockId id, const cfg::RegOrder order) const { return stack[order][id]; }
+	// check if at-entry state of a BB was set
+	bool isReached(const BlockId id) const { return reached[id]; }
+};
+
+typedef BasicFrozenGraph< reg::reg_count_max > FrozenGraph;
+
+template < size_t RegCount >
+inline BasicFrozenGraph< RegCount >::BasicFrozenGraph(const ControlFlowGraph& graph)
+{
+	using namespace bb;
+
+	// BBs in address order get ids 0..n-1
+	for (const auto& it : graph) {
+		const Address addr = it.getStartAddress();
+		const Instructions& seq = it.getSequence();
+
+		instrOffset.push_back(uint32_t(instr.size()));
+		instr.insert(instr.end(), seq.begin(), seq.end());
+		start.push_back(addr);
+
+		for (size_t i = 0; i < cfg::order__count; ++i) {
+			valueOffset[i].push_back(uint32_t(value[i].size()));
+			for (const auto& jt : graph.getRegistry(addr)[i])
+				value[i].push_back(RegValue(jt.first, jt.second));
+
+			stack[i].push_back(graph.getStack(addr)[i]);
+		}
+
+		reached.push_back(graph.isReached(addr));
+	}
+
+	instrOffset.push_back(uint32_t(instr.size()));
+
+	for (size_t i = 0; i < cfg::order__count; ++i)
+		valueOffset[i].push_back(uint32_t(value[i].size()));
+
+	// successors, unique per BB
+	BTB targets;
+	std::vector< uint32_t > predCount(start.size() + 1, 0);
+
+	for (BlockId id = 0; id < start.size(); ++id) {
+		succOffset.push_back(uint32_t(succ.size()));
+		graph.getExitTargets(start[id], targets);
+
+		for (const auto target : targets) {
+			const BlockId tid = findBlock(target);
+			if (block_invalid == tid || std::find(succ.begin() + succOffset[id], succ.end(), tid) != succ.end())
+				continue;
+
+			succ.push_back(tid);
+			++predCount[tid + 1];
+		}
+	}
+
+	succOffset.push_back(uint32_t(succ.size()));
+
+	// predecessors -- transpose of successors via counting sort
+	for (size_t i = 1; i < predCount.size(); ++i)
+		predCount[i] += predCount[i - 1];
+
+	predOffset = predCount;
+	pred.resize(succ.size());
+
+	for (BlockId id = 0; id < start.size(); ++id) {
+		for (const BlockId* it = beginSucc(id); it != endSucc(id); ++it)
+			pred[predCount[*it]++] = id;
+	}
+}
+
+template < size_t RegCount >
+inline BlockId BasicFrozenGraph< RegCount >::findBlock(const bb::Address addr) const
+{
+	const std::vector< bb::Address >::const_iterator it = std::lower_bound(start.begin(), start.end(), addr,
+		[](const bb::Address lhs, const bb::Address rhs) { return uint32_t(lhs) < uint32_t(rhs); });
+
+	return it != start.end() && uint32_t(*it) == uint32_t(addr) ? BlockId(it - start.begin()) : block_invalid;
+}
+
+template < size_t RegCount >
+inline std::pair< const RegValue*, const RegValue* > BasicFrozenGraph< RegCount >::getValues(const BlockId id,
+	const cfg::RegOrder order, const reg::Register r) const
+{
+	return std::equal_range(beginValues(id, order), endValues(id, order), RegValue(r, isa::word_invalid),
+		[](const RegValue& lhs, const RegValue& rhs) { return lhs.first < rhs.first; });
+}
+
+} // namespace csr
+
+#endif // __csr_h
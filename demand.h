@@ -0,0 +1,238 @@
+#if !defined(__demand_h)
+#define __demand_h
+
+#include <assert.h>
+#include <utility>
+#include <vector>
+#include <map>
+#include <set>
+#include "isa.h"
+#include "bb.h"
+#include "cfg.h"
+
+// Demand-driven analysis -- compute the registry at entry of a given BB from just the BBs it transitively depends on,
+// memoizing results across queries, and leaving the rest of the CFG unanalysed
+
+namespace demand {
+
+template < size_t RegCount >
+class BasicAnalysis {
+public:
+	typedef cfg::BasicControlFlowGraph< RegCount > ControlFlowGraph;
+	typedef typename ControlFlowGraph::Registry Registry;
+	typedef typename ControlFlowGraph::Stack Stack;
+
+private:
+	typedef std::set< bb::Address > Addresses;
+	typedef std::map< bb::Address, std::vector< bb::Address > > Preds;
+	typedef std::map< bb::Address, std::pair< Registry, Stack > > Seeds;
+
+	ControlFlowGraph& graph; // CFG whose registries hold the memoized results
+	Preds preds; // potential predecessors via static edges -- fall-throughs and branches to registers loaded in the same BB
+	std::vector< bb::Address > dynamicSources; // BBs branching to registers not loaded in the same BB
+	Addresses addressTaken; // BBs whose start is loaded as an immediate anywhere -- potential targets of dynamic sources
+	Seeds seeds; // at-entry states of program entries
+	Addresses solved; // BBs whose at-entry registries are final; the registries of the rest are left as found, until demanded
+
+	// index potential predecessors of all BBs
+	void index();
+	void collect(const bb::Address, Addresses& demanded, Addresses& boundary) const;
+
+public:
+	// index potential predecessors of all BBs in the given CFG; its registries are left as they are until the BBs get
+	// demanded, when they are computed anew
+	explicit BasicAnalysis(ControlFlowGraph&);
+
+	// set registry and 'storage' stack at a program entry; drops all memoized results
+	bool setEntry(const bb::Address, Registry&&, const Stack& = Stack());
+	// get registry at BB entry, computing it and the registries of all BBs it depends on if not already computed; the
+	// returned ptr is an array, use RegOrder to index; return nullptr for unknown, unreached or failing BBs
+	const Registry* getRegistry(const bb::Address);
+	// check if the registry at BB entry was already computed
+	bool isSolved(const bb::Address address) const { return solved.count(address); }
+	// get the number of BBs with computed registries
+	size_t getSolvedCount() const { return solved.size(); }
+	// drop all memoized results, and index potential predecessors anew, e.g. after the CFG got edited
+	void reset();
+};
+
+typedef BasicAnalysis< reg::reg_count_max > Analysis;
+
+template < size_t RegCount >
+inline BasicAnalysis< RegCount >::BasicAnalysis(ControlFlowGraph& graph) : graph(graph)
+{
+	index();
+}
+
+template < size_t RegCount >
+inline void BasicAnalysis< RegCount >::index()
+{
+	using namespace bb;
+	using namespace isa;
+
+	preds.clear();
+	dynamicSources.clear();
+	addressTaken.clear();
+
+	for (const auto& it : graph) {
+		const Address start = it.getStartAddress();
+		const Instructions& seq = it.getSequence();
+
+		for (size_t i = 0; isAddrValid(it.getExitTargetAddress(i)); ++i)
+			preds[it.getExitTargetAddress(i)].push_back(start);
+
+		for (const auto instr : seq) {
+			if (op_li == instr.getOpcode())
+				addressTaken.insert(Address(instr.getImm()));
+		}
+
+		if (!isBranch(seq.back().getOpcode()))
+			continue;
+
+		// find the last definition of the branch-target register in the BB
+		const Operand target = seq.back().getOperand(0);
+		bool dynamic = true;
+
+		for (size_t i = seq.size() - 1; i-- > 0; ) {
+			const Opcode op = seq[i].getOpcode();
+			if (target != seq[i].getOperand(0))
+				continue;
+
+			if (op_li == op) {
+				preds[Address(seq[i].getImm())].push_back(start);
+				dynamic = false;
+				break;
+			}
+			if (op_pop == op || op_push == op || op_op2 == op || op_op3 == op)
+				break;
+		}
+
+		if (dynamic)
+			dynamicSources.push_back(start);
+	}
+}
+
+template < size_t RegCount >
+inline bool BasicAnalysis< RegCount >::setEntry(const bb::Address start, Registry&& reg, const Stack& stack)
+{
+	if (!graph.getBasicBlock(start))
+		return false;
+
+	seeds[start] = std::make_pair(std::move(reg), stack);
+	solved.clear();
+	return true;
+}
+
+template < size_t RegCount >
+inline void BasicAnalysis< RegCount >::reset()
+{
+	solved.clear();
+	index();
+}
+
+template < size_t RegCount >
+inline void BasicAnalysis< RegCount >::collect(const bb::Address start, Addresses& demanded, Addresses& boundary) const
+{
+	std::vector< bb::Address > work(1, start);
+	demanded.insert(start);
+
+	const auto visit = [&](const bb::Address pred) {
+		if (solved.count(pred))
+			boundary.insert(pred);
+		else if (demanded.insert(pred).second)
+			work.push_back(pred);
+	};
+
+	while (!work.empty()) {
+		const bb::Address curr = work.back();
+		work.pop_back();
+
+		const typename Preds::const_iterator it = preds.find(curr);
+		if (it != preds.end()) {
+			for (const auto pred : it->second)
+				visit(pred);
+		}
+
+		if (addressTaken.count(curr)) {
+			for (const auto pred : dynamicSources)
+				visit(pred);
+		}
+	}
+}
+
+template < size_t RegCount >
+inline const typename BasicAnalysis< RegCount >::Registry* BasicAnalysis< RegCount >::getRegistry(const bb::Address start)
+{
+	if (!graph.getBasicBlock(start))
+		return nullptr;
+
+	if (solved.count(start))
+		return graph.isReached(start) ? graph.getRegistry(start) : nullptr;
+
+	Addresses demanded;
+	Addresses boundary;
+	collect(start, demanded, boundary);
+
+	// registries of demanded BBs are stale or pre-existing ones, computed for other entries or before edits
+	for (const auto it : demanded)
+		graph.resetRegistry(it);
+
+	// solve the demanded BBs to a fixpoint, fed by program entries among them and by already-solved BBs around them
+	std::vector< bb::Address > work;
+	bool changed;
+
+	// leave no partial results behind
+	const auto fail = [&]() -> const Registry* {
+		for (const auto it : demanded)
+			graph.resetRegistry(it);
+		return nullptr;
+	};
+
+	for (const auto it : demanded) {
+		const typename Seeds::const_iterator jt = seeds.find(it);
+		if (jt == seeds.end())
+			continue;
+
+		if (!graph.mergeRegistry(it, jt->second.first, jt->second.second, changed))
+			return fail();
+		work.push_back(it);
+	}
+
+	bb::BTB targets;
+	const auto propagate = [&](const bb::Address source) -> bool {
+		graph.getExitTargets(source, targets);
+
+		for (const auto target : targets) {
+			if (!demanded.count(target))
+				continue;
+
+			if (!graph.mergeRegistry(target, graph.getRegistry(source)[cfg::order_exit], graph.getStack(source)[cfg::order_exit], changed))
+				return false;
+
+			if (changed)
+				work.push_back(target);
+		}
+
+		return true;
+	};
+
+	for (const auto it : boundary) {
+		if (graph.isReached(it) && !propagate(it))
+			return fail();
+	}
+
+	while (!work.empty()) {
+		const bb::Address curr = work.back();
+		work.pop_back();
+
+		if (!graph.calcRegistry(curr) || !propagate(curr))
+			return fail();
+	}
+
+	solved.insert(demanded.begin(), demanded.end());
+	return graph.isReached(start) ? graph.getRegistry(start) : nullptr;
+}
+
+} // namespace demand
+
+#endif // __demand_h
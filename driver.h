@@ -0,0 +1,317 @@
+#if !defined(__driver_h)
+#define __driver_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "bb.h"
+#include "reg.h"
+#include "cfg.h"
+#include "opt.h"
+#include "conv.h"
+#include "wrap.h"
+#include "reloc.h"
+#include "image.h"
+#include "server.h"
+
+// Batch driver -- load, analyse, optimise and emit many program images on a bounded pool of worker threads
+
+namespace driver {
+
+// outcome of processing a single image
+struct Outcome {
+	bool success = false;
+	size_t regCount = 0; // width of the GPR file the image was analysed with
+	size_t instrCount = 0; // instructions in the input image
+	size_t blockCount = 0; // BBs in the input image
+	size_t loadsEliminated = 0; // redundant loads eliminated
+	size_t spillsRemoved = 0; // save/restore pairs removed
+	size_t spillsMoved = 0; // save/restore pairs shrink-wrapped
+	size_t instrEmitted = 0; // instructions in the output image
+	size_t peakMemory = 0; // largest memory usage of the CFG sampled during analysis, in bytes
+};
+
+// per-worker state, kept from image to image so that workers recycle their own buffers rather than going back to the
+// (shared) allocator for every image; the nodes of registries, 'storage' stacks and BB sets come from per-thread pools
+// (see mem::Pool), so each worker recycles those too; vector buffers -- instructions, BTBs, spilled values, summaries --
+// still go to the shared allocator
+struct Worker {
+	image::Image input;
+	image::Image output;
+	reloc::AddressMap map;
+	std::string path;
+};
+
+// load an image from a file, decoding it on the given number of threads, analyse it from its base, with cbr comparing as
+// per the given predicate, if any, optimise it, and emit
+// the optimised image and its address map to the given directory, if any, under the image file name and the same with a
+// '.map' suffix, respectively
+inline bool process(const char* const path, const char* const outDir, const size_t decoderCount, const cfg::Predicate predicate,
+	Worker& worker, Outcome& outcome)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "error: cannot open %s\n", path);
+		return false;
+	}
+
+	const bool loaded = image::read(f, worker.input);
+	fclose(f);
+
+	if (!loaded || worker.input.instr.empty()) {
+		fprintf(stderr, "error: malformed image %s\n", path);
+		return false;
+	}
+
+	size_t regCount = bb::getRegCount(worker.input.instr);
+	for (const auto it : worker.input.args)
+		regCount = std::max(regCount, size_t(it) + 1);
+
+	if (regCount > reg::reg_count_max) {
+		fprintf(stderr, "error: image %s needs %lu registers, more than the %lu supported\n", path, regCount, reg::reg_count_max);
+		return false;
+	}
+
+	outcome.instrCount = worker.input.instr.size();
+
+	const bool success = reg::dispatch(regCount, [&](auto width) -> bool {
+		constexpr size_t RegCount = decltype(width)::value;
+		typedef cfg::BasicControlFlowGraph< RegCount > ControlFlowGraph;
+
+		outcome.regCount = RegCount;
+
+		ControlFlowGraph graph;
+		graph.setPredicate(predicate);
+		if (!image::load(worker.input, graph, decoderCount))
+			return false;
+
+		for (auto it = graph.begin(); it != graph.end(); ++it)
+			++outcome.blockCount;
+
+		// sample about once per pass over the CFG, keeping the sampling cost in proportion to the analysis
+		graph.setMemorySampling(outcome.blockCount);
+		if (!graph.solve(worker.input.base))
+			return false;
+
+		outcome.peakMemory = graph.getPeakMemoryUsage().total();
+
+		outcome.loadsEliminated = opt::eliminateRedundantLoads(graph, worker.input.base);
+
+		// the link register of the image entry is unknown, so only functions called within the image get recognised
+		conv::Functions functions;
+		if (!conv::recognise(graph, functions))
+			return false;
+
+		// shrink-wrapping emits the relocated image, packed and solved anew
+		ControlFlowGraph relocated;
+		wrap::Result wrapped;
+		const bool wrapSuccess = wrap::shrinkWrap(graph, functions, worker.input.base, relocated, worker.output, worker.map, wrapped);
+		outcome.spillsRemoved = wrapped.removed;
+		outcome.spillsMoved = wrapped.moved;
+		return wrapSuccess;
+	});
+
+	if (!success) {
+		fprintf(stderr, "error: cannot analyse image %s\n", path);
+		return false;
+	}
+
+	worker.output.args = worker.input.args;
+	outcome.instrEmitted = worker.output.instr.size();
+
+	if (!outDir)
+		return true;
+
+	const char* const name = strrchr(path, '/');
+	worker.path = outDir;
+	worker.path += '/';
+	worker.path += name ? name + 1 : path;
+
+	f = fopen(worker.path.c_str(), "wb");
+	const bool written = f && image::write(f, worker.output);
+	if (f)
+		fclose(f);
+
+	if (!written) {
+		fprintf(stderr, "error: cannot emit %s\n", worker.path.c_str());
+		return false;
+	}
+
+	worker.path += ".map";
+	f = fopen(worker.path.c_str(), "w");
+	const bool mapped = f && reloc::writeAddressMap(f, worker.map);
+	if (f)
+		fclose(f);
+
+	if (!mapped) {
+		fprintf(stderr, "error: cannot emit %s\n", worker.path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+// read image paths from a manifest, one per line; empty lines and lines starting with '#' are skipped
+inline bool readManifest(const char* const path, std::vector< std::string >& paths)
+{
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "error: cannot open manifest %s\n", path);
+		return false;
+	}
+
+	char line[4096];
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if ('\0' != line[0] && '#' != line[0])
+			paths.push_back(line);
+	}
+
+	fclose(f);
+	return true;
+}
+
+// load images, analysed with cbr comparing as per the given predicate, if any, and serve queries about them at the given
+// socket until shut down -- see server.h; return non-zero if any image failed or the socket could not be listened at
+inline int serve(const char* const socketPath, const cfg::Predicate predicate, const std::vector< std::string >& paths)
+{
+	server::Server srv(predicate);
+
+	for (const auto& it : paths) {
+		uint32_t id;
+		size_t blockCount;
+		if (!srv.load(it.c_str(), id, blockCount))
+			return 1;
+
+		fprintf(stdout, "%s: image %u, %lu BBs\n", it.c_str(), id, blockCount);
+	}
+
+	fflush(stdout);
+	return srv.serve(socketPath) ? 0 : 1;
+}
+
+// command line: [-j threads] [-d decoder-threads] [-p eq|ne|lt|ge] [-o output-dir] [-m manifest] [-s socket] [image ...]; report one line
+// per image in input order, followed by throughput; return non-zero if any image failed; given a socket, rather load the images
+// and serve queries about them there until shut down -- see server.h
+inline int run(const int argc, char** const argv)
+{
+	size_t threadCount = std::thread::hardware_concurrency();
+	size_t decoderCount = 1;
+	cfg::Predicate predicate = nullptr;
+	const char* outDir = nullptr;
+	const char* socketPath = nullptr;
+	std::vector< std::string > paths;
+
+	for (int i = 1; i < argc; ++i) {
+		if (0 == strcmp(argv[i], "-j") && i + 1 < argc)
+			threadCount = strtoul(argv[++i], nullptr, 10);
+		else if (0 == strcmp(argv[i], "-d") && i + 1 < argc)
+			decoderCount = std::max(size_t(1), size_t(strtoul(argv[++i], nullptr, 10)));
+		else if (0 == strcmp(argv[i], "-p") && i + 1 < argc) {
+			const struct {
+				const char* name;
+				cfg::Predicate predicate;
+			} predicates[] = {
+				{ "eq", cfg::compareEqual },
+				{ "ne", cfg::compareNotEqual },
+				{ "lt", cfg::compareLess },
+				{ "ge", cfg::compareGreaterEqual }
+			};
+
+			++i;
+			for (const auto& it : predicates) {
+				if (0 == strcmp(argv[i], it.name))
+					predicate = it.predicate;
+			}
+
+			if (!predicate) {
+				fprintf(stderr, "error: unknown predicate %s\n", argv[i]);
+				return 255;
+			}
+		}
+		else if (0 == strcmp(argv[i], "-o") && i + 1 < argc)
+			outDir = argv[++i];
+		else if (0 == strcmp(argv[i], "-s") && i + 1 < argc)
+			socketPath = argv[++i];
+		else if (0 == strcmp(argv[i], "-m") && i + 1 < argc) {
+			if (!readManifest(argv[++i], paths))
+				return 255;
+		}
+		else if ('-' == argv[i][0]) {
+			fprintf(stderr, "usage: %s [-j threads] [-d decoder-threads] [-p eq|ne|lt|ge] [-o output-dir] [-m manifest] [-s socket] [image ...]\n", argv[0]);
+			return 255;
+		}
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if (socketPath)
+		return serve(socketPath, predicate, paths);
+
+	threadCount = std::max(size_t(1), std::min(threadCount, paths.size()));
+
+	std::vector< Outcome > outcomes(paths.size());
+	std::atomic< size_t > next(0);
+
+	const auto work = [&]() {
+		Worker worker;
+		for (size_t i = next++; i < paths.size(); i = next++)
+			outcomes[i].success = process(paths[i].c_str(), outDir, decoderCount, predicate, worker, outcomes[i]);
+	};
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector< std::thread > pool;
+	for (size_t i = 1; i < threadCount; ++i)
+		pool.push_back(std::thread(work));
+
+	work();
+
+	for (auto& it : pool)
+		it.join();
+
+	const double duration = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+
+	size_t failCount = 0;
+	size_t instrCount = 0;
+	for (size_t i = 0; i < paths.size(); ++i) {
+		const Outcome& outcome = outcomes[i];
+
+		if (!outcome.success) {
+			fprintf(stdout, "%s: failed\n", paths[i].c_str());
+			++failCount;
+			continue;
+		}
+
+		fprintf(stdout, "%s: %lu-register file, %lu instrs, %lu BBs, %lu loads eliminated, %lu spills removed, %lu spills moved, "
+			"%lu instrs emitted, %lu bytes peak\n",
+			paths[i].c_str(),
+			outcome.regCount,
+			outcome.instrCount,
+			outcome.blockCount,
+			outcome.loadsEliminated,
+			outcome.spillsRemoved,
+			outcome.spillsMoved,
+			outcome.instrEmitted,
+			outcome.peakMemory);
+
+		instrCount += outcome.instrCount;
+	}
+
+	fprintf(stdout, "%lu images (%lu failed) on %lu threads in %f s: %f images/s, %f instrs/s\n",
+		paths.size(), failCount, threadCount, duration,
+		duration > 0.0 ? (paths.size() - failCount) / duration : 0.0,
+		duration > 0.0 ? instrCount / duration : 0.0);
+
+	return failCount ? 1 : 0;
+}
+
+} // namespace driver
+
+#endif // __driver_h
@@ -0,0 +1,225 @@
+#if !defined(__image_h)
+#define __image_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "isa.h"
+#include "bb.h"
+#include "cfg.h"
+#include "builder.h"
+#include "bulk.h"
+
+// Program image -- a contiguous sequence of instructions at a base address, and its on-disk form
+
+namespace image {
+
+typedef std::vector< isa::Operand > Args;
+
+struct Image {
+	bb::Address base = bb::addr_invalid; // address of the first instruction, also the program entry
+	bb::Instructions instr; // instructions, at consecutive addresses
+	Args args; // registers occupied by unknowns (e.g. an LR) at program entry
+};
+
+// image file: 32-bit LE magic, 32-bit LE base address, 32-bit LE instruction count, 32-bit LE argument count, followed by
+// that many instructions, 4 bytes each: operands r0..r2 followed by the opcode, followed by that many 8-bit argument registers
+constexpr uint32_t image_magic = 0x4c505344; // 'DSPL'
+
+namespace detail {
+
+// append a 32-bit LE word to a buffer
+inline void putWord(std::vector< uint8_t >& buffer, const uint32_t word)
+{
+	for (size_t i = 0; i < sizeof(word); ++i)
+		buffer.push_back(uint8_t(word >> i * 8));
+}
+
+// read a 32-bit LE word; return false on end of file
+inline bool getWord(FILE* f, uint32_t& word)
+{
+	uint8_t bytes[sizeof(word)];
+	if (1 != fread(bytes, sizeof(bytes), 1, f))
+		return false;
+
+	word = 0;
+	for (size_t i = 0; i < sizeof(word); ++i)
+		word |= uint32_t(bytes[i]) << i * 8;
+
+	return true;
+}
+
+} // namespace detail
+
+// write out an image in the file format above, each instruction encoded as per isa::encodeInstr, independent of the host
+// byte order and instruction layout
+inline bool write(FILE* f, const Image& image)
+{
+	std::vector< uint8_t > buffer;
+	buffer.reserve((4 + image.instr.size()) * sizeof(uint32_t) + image.args.size());
+
+	detail::putWord(buffer, image_magic);
+	detail::putWord(buffer, image.base);
+	detail::putWord(buffer, uint32_t(image.instr.size()));
+	detail::putWord(buffer, uint32_t(image.args.size()));
+
+	for (const auto it : image.instr)
+		detail::putWord(buffer, isa::encodeInstr(it));
+
+	buffer.insert(buffer.end(), image.args.begin(), image.args.end());
+	return 1 == fwrite(buffer.data(), buffer.size(), 1, f);
+}
+
+// read in an image in the file format above, each instruction decoded as per isa::decodeInstr; return false on a
+// malformed image
+inline bool read(FILE* f, Image& image)
+{
+	uint32_t header[4];
+	for (auto& it : header) {
+		if (!detail::getWord(f, it))
+			return false;
+	}
+
+	if (image_magic != header[0] || 0 != header[1] >> 31)
+		return false;
+
+	// there can be no more args than registers
+	if (header[3] > isa::reg_invalid)
+		return false;
+
+	image.base = bb::Address(header[1]);
+	image.instr.clear();
+
+	for (uint32_t i = 0; i < header[2]; ++i) {
+		uint32_t raw;
+		if (!detail::getWord(f, raw))
+			return false;
+
+		image.instr.push_back(isa::decodeInstr(raw));
+	}
+
+	image.args.resize(header[3]);
+	if (image.args.size() != fread(image.args.data(), sizeof(isa::Operand), image.args.size(), f))
+		return false;
+
+	// args are registers, and reg-invalid is none
+	return image.args.end() == std::find(image.args.begin(), image.args.end(), isa::reg_invalid);
+}
+
+// get the start addresses of the BBs an image splits into: its base, every address past a branch, and every address
+// within the image loaded as an immediate (i.e. a potential branch target), in ascending order; takes the image's
+// instruction classes, as per bulk::classify
+inline void getLeaders(const Image& image, const bulk::Classes& classes, std::vector< bb::Address >& leaders)
+{
+	using namespace isa;
+
+	const uint32_t base = image.base;
+	const uint32_t end = base + uint32_t(image.instr.size());
+	std::vector< bool > leader(image.instr.size() + 1, false);
+	leader[0] = true;
+
+	// visit just the set bits of each word
+	for (size_t i = 0; i < classes.branch.size(); ++i) {
+		for (uint64_t word = classes.branch[i]; word; word &= word - 1)
+			leader[i * 64 + __builtin_ctzll(word) + 1] = true;
+
+		for (uint64_t word = classes.load[i]; word; word &= word - 1) {
+			const uint32_t imm = image.instr[i * 64 + __builtin_ctzll(word)].getImm();
+			if (base <= imm && imm < end)
+				leader[imm - base] = true;
+		}
+	}
+
+	leaders.clear();
+	for (size_t i = 0; i < image.instr.size(); ++i) {
+		if (leader[i])
+			leaders.push_back(bb::Address(base + uint32_t(i)));
+	}
+}
+
+// get the start addresses of the BBs an image splits into, as above, classifying its instructions first
+inline void getLeaders(const Image& image, std::vector< bb::Address >& leaders)
+{
+	bulk::Classes classes;
+	bulk::classify(image.instr.data(), image.instr.size(), classes);
+	getLeaders(image, classes, leaders);
+}
+
+// split an image into BBs and add them to an empty CFG, with an at-entry registry set up at the image base; the BBs get
+// decoded and validated by the given number of threads, each taking a contiguous chunk of them; return false if any BB is
+// invalid
+template < size_t RegCount >
+inline bool load(const Image& image, cfg::BasicControlFlowGraph< RegCount >& graph, const size_t threadCount = 1)
+{
+	using namespace bb;
+
+	// reject images of invalid instructions up front, before splitting them
+	bulk::Classes classes;
+	if (bulk::classify(image.instr.data(), image.instr.size(), classes)) {
+		for (size_t i = 0; i < classes.invalid.size(); ++i) {
+			if (classes.invalid[i]) {
+				const size_t index = i * 64 + __builtin_ctzll(classes.invalid[i]);
+				fprintf(stderr, "error: invalid instruction at %08x\n", uint32_t(image.base) + uint32_t(index));
+				break;
+			}
+		}
+		return false;
+	}
+
+	std::vector< Address > leaders;
+	getLeaders(image, classes, leaders);
+
+	const size_t chunkCount = std::max(size_t(1), std::min(threadCount, leaders.size()));
+	build::BasicBuilder< RegCount > builder(chunkCount);
+	std::vector< uint8_t > valid(chunkCount, 1); // per chunk, all its BBs valid
+
+	const auto decode = [&](const size_t chunk) {
+		const size_t lo = leaders.size() * chunk / chunkCount;
+		const size_t hi = leaders.size() * (chunk + 1) / chunkCount;
+
+		for (size_t i = lo; i < hi; ++i) {
+			const size_t first = leaders[i] - image.base;
+			const size_t last = i + 1 < leaders.size() ? leaders[i + 1] - image.base : image.instr.size();
+
+			BasicBlock block(leaders[i]);
+			for (size_t j = first; j < last; ++j)
+				block.addInstr(image.instr[j]);
+
+			if (!block.validate()) {
+				fprintf(stderr, "error: invalid BB at %08x\n", uint32_t(leaders[i]));
+				valid[chunk] = 0;
+				continue;
+			}
+
+			builder.addBasicBlock(chunk, std::move(block));
+		}
+	};
+
+	std::vector< std::thread > pool;
+	for (size_t i = 1; i < chunkCount; ++i)
+		pool.push_back(std::thread(decode, i));
+
+	decode(0);
+
+	for (auto& it : pool)
+		it.join();
+
+	const bool built = builder.build(graph);
+	if (!built || valid.end() != std::find(valid.begin(), valid.end(), 0))
+		return false;
+
+	typename cfg::BasicControlFlowGraph< RegCount >::Registry reg;
+	for (const auto it : image.args) {
+		if (it >= RegCount)
+			return false;
+		reg.addUnknown(it);
+	}
+
+	return leaders.empty() || graph.setRegistry(image.base, std::move(reg));
+}
+
+} // namespace image
+
+#endif // __image_h
@@ -94,6 +94,8 @@ public:
 	void setOperand(const size_t index, const Operand reg, const bool invalidateRest = false);
 	// get instruction immediate operand
 	uint32_t getImm() const;
+	// set instruction immediate operand; return false if the immediate is not representable
+	bool setImm(const uint32_t);
 };
 
 inline Opcode Instr::getOpcode() const
@@ -155,6 +157,37 @@ inline uint32_t Instr::getImm() const
 	return Word(int16_t(uint16_t(r[1]) + (uint16_t(r[2]) << 8)), 0);
 }
 
+inline bool Instr::setImm(const uint32_t imm)
+{
+	assert(op_li == op);
+	const uint16_t lo = uint16_t(imm);
+
+	if (Word(int16_t(lo), 0) != Word(imm, 0))
+		return false;
+
+	r[1] = Operand(lo);
+	r[2] = Operand(lo >> 8);
+	return true;
+}
+
+// decode an instruction from its 32-bit LE encoding: operands r0..r2 followed by the opcode; encodings of no valid
+// instruction, e.g. with the reserved opcode bit set, decode to instructions whose opcode is op-invalid
+inline Instr decodeInstr(const uint32_t raw)
+{
+	Instr instr(Opcode(raw >> 24));
+	instr.setOperand(0, Operand(raw));
+	instr.setOperand(1, Operand(raw >> 8));
+	instr.setOperand(2, Operand(raw >> 16));
+	return instr;
+}
+
+// encode a valid instruction into its 32-bit LE encoding, as per decodeInstr
+inline uint32_t encodeInstr(const Instr instr)
+{
+	return uint32_t(instr.getOperand(0)) | uint32_t(instr.getOperand(1)) << 8 | uint32_t(instr.getOperand(2)) << 16 |
+		uint32_t(instr.getOpcode()) << 24;
+}
+
 inline const char* strFromOpcode(const Opcode op)
 {
 	switch (op) {
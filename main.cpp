@@ -1,9 +1,31 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <alloca.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <utility>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_set>
 #include "isa.h"
 #include "bb.h"
 #include "cfg.h"
+#include "stream.h"
+#include "opt.h"
+#include "reloc.h"
+#include "driver.h"
+#include "conv.h"
+#include "wrap.h"
+#include "image.h"
+#include "demand.h"
+#include "csr.h"
+#include "builder.h"
+#include "bulk.h"
+#include "storage.h"
 
 enum AddressColor : uint8_t {
 	addrcolor_err,
@@ -38,7 +60,8 @@ void print(FILE* f, const bb::BasicBlock& block, const AddressColor addrcolor =
 	}
 }
 
-void print(FILE* f, const reg::Registry& registry, const bb::Address address)
+template < size_t RegCount >
+void print(FILE* f, const reg::BasicRegistry< RegCount >& registry, const bb::Address address)
 {
 	fprintf(f, "\033[38;5;13m%08x\033[0m\n", address);
 
@@ -66,8 +89,1172 @@ void print(FILE* f, const reg::Registry& registry, const bb::Address address)
 	fprintf(f, "}\n");
 }
 
-int main(int, char **)
+// behaviour checks -- run after the demo; every failed check gets reported, and fails the demo as a whole
+size_t checkFailures = 0;
+
+void check(const bool condition, const char* const what)
+{
+	if (condition)
+		return;
+
+	fprintf(stderr, "check failed: %s\n", what);
+	++checkFailures;
+}
+
+isa::Instr makeInstr(const isa::Opcode op, const isa::Operand r0 = isa::reg_invalid, const isa::Operand r1 = isa::reg_invalid,
+	const isa::Operand r2 = isa::reg_invalid)
+{
+	isa::Instr instr(op);
+	instr.setOperand(0, r0);
+	instr.setOperand(1, r1);
+	instr.setOperand(2, r2);
+	return instr;
+}
+
+isa::Instr makeLoad(const isa::Operand reg, const uint32_t imm)
+{
+	isa::Instr instr(isa::op_li);
+	instr.setOperand(0, reg);
+	const bool success = instr.setImm(imm);
+	assert(success);
+	return instr;
+}
+
+// check if two registries hold the same values in every register, in any order
+template < size_t RegCount >
+bool isSameRegistry(const reg::BasicRegistry< RegCount >& lhs, const reg::BasicRegistry< RegCount >& rhs)
+{
+	std::vector< uint32_t > lvalues;
+	std::vector< uint32_t > rvalues;
+
+	for (reg::Register r = 0; r < RegCount; ++r) {
+		conv::detail::getValues(lhs, r, lvalues);
+		conv::detail::getValues(rhs, r, rvalues);
+		if (lvalues != rvalues)
+			return false;
+	}
+
+	return true;
+}
+
+// lay out a program of BBs as an image, filling any gaps between BBs with nops
+image::Image makeImage(const std::vector< bb::BasicBlock >& program)
 {
+	image::Image image;
+	image.base = program.front().getStartAddress();
+
+	for (const auto& it : program) {
+		while (uint32_t(image.base) + image.instr.size() < uint32_t(it.getStartAddress()))
+			image.instr.push_back(makeInstr(isa::op_nop));
+
+		image.instr.insert(image.instr.end(), it.getSequence().begin(), it.getSequence().end());
+	}
+
+	return image;
+}
+
+// streaming analysis of a program whose function gets called from two regions, the second call reaching it only after
+// its region got evicted; every BB should end up as per a resident analysis, and the regions re-entered via back-edges
+// should get analysed anew
+void checkStreaming()
+{
+	using namespace isa;
+	typedef reg::BasicRegistry< reg::reg_count_16 > Registry;
+
+	image::Image image;
+	image.base = 0x100;
+	image.args.push_back(5); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(1, 0x109), makeLoad(2, 0x104), makeLoad(3, 1), makeInstr(op_br, 1), // 0x100: call foo
+		makeLoad(1, 0x109), makeLoad(2, 0x108), makeLoad(3, 2), makeInstr(op_br, 1), // 0x104: call foo again
+		makeInstr(op_br, 5),                                                         // 0x108: return
+		makeInstr(op_op2, 3, 3), makeInstr(op_br, 2)                                 // 0x109: foo
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+	const bool solved = image::load(image, graph) && graph.solve(image.base);
+	check(solved, "stream: resident analysis");
+
+	FILE* const spill = tmpfile();
+	stream::BasicAnalyser< reg::reg_count_16 > analyser(image, spill);
+	{
+		Registry reg;
+		reg.addUnknown(5);
+		check(analyser.setEntry(image.base, std::move(reg)) && analyser.analyse(), "stream: streaming analysis");
+	}
+
+	check(4 == analyser.getRegions().size(), "stream: regions split at called and returned-to BBs");
+	check(analyser.getPeakResident() < 4, "stream: at most one region resident");
+	check(2 == analyser.getSummaries()[3].passes, "stream: callee analysed anew on its second call");
+	check(0 == analyser.getRegions()[0].rank, "stream: entry region ranked first");
+
+	// the spill file holds the registries of every analysis of every region; the last records count
+	std::map< uint32_t, std::pair< Registry, Registry > > spilled;
+	rewind(spill);
+
+	bb::Address start = bb::addr_invalid;
+	Registry reg[cfg::order__count];
+	while (stream::readSpilledBlock(spill, start, reg))
+		spilled[start] = std::make_pair(reg[cfg::order_entry], reg[cfg::order_exit]);
+
+	fclose(spill);
+
+	size_t reached = 0;
+	for (const auto& it : graph) {
+		if (!graph.isReached(it.getStartAddress()))
+			continue;
+
+		const Registry* const resident = graph.getRegistry(it.getStartAddress());
+		const auto jt = spilled.find(it.getStartAddress());
+		check(jt != spilled.end() && isSameRegistry(jt->second.first, resident[cfg::order_entry]) &&
+			isSameRegistry(jt->second.second, resident[cfg::order_exit]), "stream: BB registries as per resident analysis");
+		++reached;
+	}
+
+	check(reached == spilled.size(), "stream: only reached BBs spilled");
+}
+
+// 'storage' stacks along two paths pushing different constants onto a common spilled value, joined before popping both;
+// the forks should share the common node, and the join should merge the stacks slot by slot
+void checkStorage()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0x200;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(0, 1), makeInstr(op_push, 0), makeLoad(3, 0), makeLoad(4, 1), makeLoad(1, 0x20a), makeInstr(op_cbr, 1, 3, 4),
+		makeLoad(0, 10), makeInstr(op_push, 0), makeLoad(2, 0x20e), makeInstr(op_br, 2), // 0x206
+		makeLoad(0, 20), makeInstr(op_push, 0), makeLoad(2, 0x20e), makeInstr(op_br, 2), // 0x20a
+		makeInstr(op_pop, 5), makeInstr(op_pop, 7), makeInstr(op_br, 6)                   // 0x20e
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+	if (!image::load(image, graph) || !graph.solve(image.base)) {
+		check(false, "storage: analysis");
+		return;
+	}
+
+	check(graph.getStack(0x206)[cfg::order_entry].same(graph.getStack(0x20a)[cfg::order_entry]), "storage: forks share nodes");
+	check(2 == graph.getStack(0x20e)[cfg::order_entry].height(), "storage: height at join");
+
+	std::vector< uint32_t > values;
+	conv::detail::getValues(graph.getRegistry(0x20e)[cfg::order_exit], 5, values);
+	check(values == std::vector< uint32_t >({ 10, 20 }), "storage: top slot merged at join");
+	conv::detail::getValues(graph.getRegistry(0x20e)[cfg::order_exit], 7, values);
+	check(values == std::vector< uint32_t >({ 1 }), "storage: common slot intact");
+}
+
+// the same program, its highest register varied, analysed at the width dispatch picks for it; the narrowest width
+// accommodating the register should get picked, with the registries as per the largest width
+void checkWidths()
+{
+	using namespace isa;
+
+	const struct {
+		Operand link;
+		size_t width;
+	} cases[] = {
+		{ 15, reg::reg_count_16 },
+		{ 31, reg::reg_count_32 },
+		{ 63, reg::reg_count_64 },
+		{ 127, reg::reg_count_max }
+	};
+
+	for (const auto& it : cases) {
+		image::Image image;
+		image.base = 0x300;
+		image.args.push_back(it.link);
+
+		const Instr program[] = {
+			makeLoad(0, 7), makeLoad(1, 0x303), makeInstr(op_br, 1),
+			makeInstr(op_op3, 2, 0, 0), makeInstr(op_push, 2), makeInstr(op_pop, 3), makeInstr(op_br, it.link) // 0x303
+		};
+		image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+		cfg::ControlFlowGraph wide;
+		const bool solved = image::load(image, wide) && wide.solve(image.base);
+		check(solved, "widths: analysis at the largest width");
+
+		const size_t regCount = std::max(bb::getRegCount(image.instr), size_t(it.link) + 1);
+		const size_t width = reg::dispatch(regCount, [&](auto width) -> size_t {
+			constexpr size_t RegCount = decltype(width)::value;
+			cfg::BasicControlFlowGraph< RegCount > graph;
+
+			if (!image::load(image, graph) || !graph.solve(image.base)) {
+				check(false, "widths: analysis at the dispatched width");
+				return RegCount;
+			}
+
+			std::vector< uint32_t > values;
+			std::vector< uint32_t > wideValues;
+
+			for (const auto& jt : graph) {
+				for (size_t i = 0; i < cfg::order__count; ++i) {
+					for (reg::Register r = 0; r < RegCount; ++r) {
+						conv::detail::getValues(graph.getRegistry(jt.getStartAddress())[i], r, values);
+						conv::detail::getValues(wide.getRegistry(jt.getStartAddress())[i], r, wideValues);
+						check(values == wideValues, "widths: registries as per the largest width");
+					}
+				}
+			}
+
+			return RegCount;
+		});
+
+		check(width == it.width, "widths: narrowest width picked");
+	}
+}
+
+// a join of two paths, the first holding a constant in a register, the second holding it too or having it vacated,
+// followed by loads of that constant, before and after a spill of the register; the load at the join should go only if
+// both paths hold the constant, while the load after restoring the register from 'storage' should go either way
+void checkRedundantLoads()
+{
+	using namespace isa;
+
+	const struct {
+		Operand restore;
+		size_t count;
+	} cases[] = {
+		{ 5, 1 }, // second path vacates the register
+		{ 1, 2 }  // second path restores the register
+	};
+
+	for (const auto& it : cases) {
+		image::Image image;
+		image.base = 0x400;
+		image.args.push_back(6); // LR of the program
+
+		const Instr program[] = {
+			makeLoad(1, 5), makeLoad(3, 0), makeLoad(4, 1), makeLoad(2, 0x407), makeInstr(op_cbr, 2, 3, 4),
+			makeInstr(op_push, 1), makeInstr(op_pop, it.restore),                                             // 0x405
+			makeLoad(1, 5), makeInstr(op_push, 1), makeLoad(1, 9), makeInstr(op_pop, 1), makeLoad(1, 5),      // 0x407
+			makeInstr(op_br, 6)
+		};
+		image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+		cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+		if (!image::load(image, graph) || !graph.solve(image.base)) {
+			check(false, "loads: analysis");
+			continue;
+		}
+
+		// the frozen form should find the same loads
+		std::vector< bb::Address > loads;
+		opt::findRedundantLoads(csr::BasicFrozenGraph< reg::reg_count_16 >(graph), image.base, loads);
+
+		check(it.count == opt::eliminateRedundantLoads(graph, image.base), "loads: redundant loads eliminated");
+		check(it.count == loads.size() && 0x40b == uint32_t(loads.back()) && (1 == it.count || 0x407 == uint32_t(loads.front())),
+			"loads: frozen form finds the same loads");
+
+		const bb::Instructions& seq = graph.getBasicBlock(0x407)->getSequence();
+		check((2 == it.count) == (op_nop == seq[0].getOpcode()), "loads: load at join kept unless held on both paths");
+		check(op_nop == seq[4].getOpcode(), "loads: load after restore eliminated");
+		check(op_li == seq[2].getOpcode(), "loads: load of another constant kept");
+	}
+}
+
+// a program forking and joining, with constants, unknowns and several values per register, frozen; the registry spans
+// of every BB should hold the values of its registries, in register order, and the edges should match the exit targets
+void checkFrozen()
+{
+	using namespace isa;
+	typedef cfg::BasicControlFlowGraph< reg::reg_count_16 > ControlFlowGraph;
+
+	image::Image image;
+	image.base = 0x480;
+	image.args.push_back(5);
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(3, 0), makeLoad(4, 1), makeLoad(1, 0x488), makeInstr(op_cbr, 1, 3, 4),
+		makeLoad(0, 10), makeInstr(op_op2, 2, 5), makeLoad(1, 0x48b), makeInstr(op_br, 1), // 0x484
+		makeLoad(0, 20), makeLoad(2, 30), makeInstr(op_op2, 4, 4),                          // 0x488: falls through
+		makeInstr(op_br, 6)                                                                 // 0x48b
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	ControlFlowGraph graph;
+	if (!image::load(image, graph) || !graph.solve(image.base)) {
+		check(false, "frozen: analysis");
+		return;
+	}
+
+	const csr::BasicFrozenGraph< reg::reg_count_16 > frozen(graph);
+	check(4 == frozen.getBlockCount(), "frozen: all BBs");
+
+	bb::BTB targets;
+	for (csr::BlockId id = 0; id < frozen.getBlockCount(); ++id) {
+		const bb::Address start = frozen.getStartAddress(id);
+		check(frozen.isReached(id) == graph.isReached(start), "frozen: reached as per CFG");
+
+		for (size_t i = 0; i < cfg::order__count; ++i) {
+			const cfg::RegOrder order = cfg::RegOrder(i);
+			const ControlFlowGraph::Registry& reg = graph.getRegistry(start)[i];
+
+			check(size_t(frozen.endValues(id, order) - frozen.beginValues(id, order)) == size_t(std::distance(reg.begin(), reg.end())),
+				"frozen: registry span of all values");
+
+			const csr::RegValue* value = frozen.beginValues(id, order);
+			for (const auto& jt : reg) {
+				check(value->first == jt.first && uint32_t(value->second) == uint32_t(jt.second) &&
+					value->second.reserved == jt.second.reserved, "frozen: registry span in register order");
+				++value;
+			}
+
+			for (reg::Register r = 0; r < reg::reg_count_16; ++r) {
+				const std::pair< const csr::RegValue*, const csr::RegValue* > values = frozen.getValues(id, order, r);
+				check(size_t(values.second - values.first) == size_t(std::distance(reg.getValues(r).first, reg.getValues(r).second)),
+					"frozen: values of a register");
+			}
+		}
+
+		graph.getExitTargets(start, targets);
+		check(size_t(frozen.endSucc(id) - frozen.beginSucc(id)) == targets.size(), "frozen: successors as per exit targets");
+
+		for (const csr::BlockId* it = frozen.beginSucc(id); it != frozen.endSucc(id); ++it) {
+			check(targets.end() != std::find(targets.begin(), targets.end(), frozen.getStartAddress(*it)) &&
+				frozen.endPred(*it) != std::find(frozen.beginPred(*it), frozen.endPred(*it), id), "frozen: edges both ways");
+		}
+	}
+
+	const csr::BlockId join = frozen.findBlock(0x48b);
+	const std::pair< const csr::RegValue*, const csr::RegValue* > r0 = frozen.getValues(join, cfg::order_entry, 0);
+	const std::pair< const csr::RegValue*, const csr::RegValue* > r2 = frozen.getValues(join, cfg::order_entry, 2);
+	check(2 == r0.second - r0.first && 2 == r2.second - r2.first && 2 == frozen.endPred(join) - frozen.beginPred(join),
+		"frozen: values of both paths at the join");
+}
+
+// BBs fed to a builder by several threads, the runs interleaving in address order, one BB overlapping a BB of another run
+// and one overlapping a BB of its own run; the CFG should get all BBs but the overlapping ones, in address order, as a
+// serial build would, and the emptied builder should take further BBs
+void checkBuilder()
+{
+	using namespace isa;
+	typedef cfg::BasicControlFlowGraph< reg::reg_count_16 > ControlFlowGraph;
+
+	const struct {
+		size_t run;
+		uint32_t start;
+		size_t size;
+	} blocks[] = {
+		{ 0, 0x10, 2 }, { 0, 0x50, 2 }, { 0, 0x30, 2 },
+		{ 1, 0x20, 2 }, { 1, 0x40, 2 }, { 1, 0x31, 2 }, // 0x31 overlaps 0x30 of run 0
+		{ 2, 0x60, 2 }, { 2, 0x61, 1 }                  // 0x61 overlaps 0x60 of its own run
+	};
+
+	build::BasicBuilder< reg::reg_count_16 > builder(3);
+	std::vector< std::thread > pool;
+
+	for (size_t run = 0; run < builder.getRunCount(); ++run) {
+		pool.push_back(std::thread([&, run]() {
+			for (const auto& it : blocks) {
+				if (it.run != run)
+					continue;
+
+				bb::BasicBlock block(it.start);
+				for (size_t i = 0; i < it.size; ++i)
+					block.addInstr(makeInstr(op_op2, 0, 1));
+				builder.addBasicBlock(run, std::move(block));
+			}
+		}));
+	}
+
+	for (auto& it : pool)
+		it.join();
+
+	ControlFlowGraph graph;
+	check(!builder.build(graph), "builder: overlapping BBs rejected");
+
+	std::vector< uint32_t > starts;
+	for (const auto& it : graph)
+		starts.push_back(it.getStartAddress());
+
+	check(starts == std::vector< uint32_t >({ 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 }), "builder: BBs as per serial build");
+
+	bb::BasicBlock block(0x70);
+	block.addInstr(makeInstr(op_op2, 0, 1));
+	builder.addBasicBlock(1, std::move(block));
+	check(builder.build(graph) && graph.getBasicBlock(0x70) && 7 == size_t(std::distance(graph.begin(), graph.end())),
+		"builder: runs emptied by a build");
+}
+
+// random encodings, biased towards valid operand patterns, classified in bulk at counts off the SIMD lane multiples; every
+// instruction should get classified as per Instr::getOpcode
+void checkBulk()
+{
+	using namespace isa;
+
+	uint32_t seed = 1;
+	const auto random = [&]() -> uint32_t {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	};
+
+	std::vector< Instr > instr;
+	for (size_t i = 0; i < 4099; ++i) {
+		uint32_t raw = 0;
+		for (size_t j = 0; j < 3; ++j)
+			raw |= (random() % 2 ? 0xff : random() & 0xff) << j * 8;
+
+		const uint32_t op = random() % 8 ? random() % op__count : random() & 0xff; // reserved bit and unknown opcodes too
+		instr.push_back(decodeInstr(raw | op << 24));
+	}
+
+	const size_t counts[] = { 0, 1, 7, 31, 64, 65, 1000, instr.size() };
+	for (const auto count : counts) {
+		bulk::Classes classes;
+		const size_t invalid = bulk::classify(instr.data(), count, classes);
+
+		size_t expected = 0;
+		bool same = true;
+		for (size_t i = 0; i < count; ++i) {
+			const Opcode op = instr[i].getOpcode();
+			expected += op_invalid == op;
+			same = same && bulk::isSet(classes.invalid, i) == (op_invalid == op) && bulk::isSet(classes.branch, i) == isBranch(op) &&
+				bulk::isSet(classes.load, i) == (op_li == op);
+		}
+
+		check(same && invalid == expected, "bulk: classes as per getOpcode");
+	}
+}
+
+// a function called twice, saving two registers in its prologue, reusing just one of them, and clobbering a third; the
+// function should get recognised along with its calls, save/restore pairs and effective convention, and its unused
+// pair should rank first
+void checkConvention()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0xb00;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(4, 1), makeLoad(3, 2), makeLoad(1, 0xb0a), makeLoad(2, 0xb05), makeInstr(op_br, 1), // call foo
+		makeLoad(1, 0xb0a), makeLoad(2, 0xb09), makeInstr(op_nop), makeInstr(op_br, 1),              // 0xb05: call foo again
+		makeInstr(op_br, 6),                                                                          // 0xb09: return
+		makeInstr(op_push, 4), makeInstr(op_push, 3), makeLoad(3, 7), makeInstr(op_op2, 5, 3),        // 0xb0a: foo
+		makeInstr(op_pop, 3), makeInstr(op_pop, 4), makeInstr(op_br, 2)
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+	conv::Functions functions;
+	if (!image::load(image, graph) || !graph.solve(image.base) || !conv::recognise(graph, functions, image.base, 6)) {
+		check(false, "convention: analysis");
+		return;
+	}
+
+	const conv::Function* foo = nullptr;
+	for (const auto& it : functions) {
+		if (0xb0a == uint32_t(it.entry))
+			foo = &it;
+	}
+
+	check(2 == functions.size() && foo, "convention: functions recognised");
+	if (!foo)
+		return;
+
+	const auto has = [](const std::vector< reg::Register >& regs, const reg::Register r) {
+		return regs.end() != std::find(regs.begin(), regs.end(), r);
+	};
+
+	check(2 == foo->link && 2 == foo->callSites.size(), "convention: link register and call sites");
+	check(2 == foo->spills.size() && 4 == foo->spills[0].reg && !foo->spills[0].used &&
+		3 == foo->spills[1].reg && foo->spills[1].used, "convention: save/restore pairs");
+
+	// r5 is unknown at entry and at the return, but not the same unknown; r3 and r4 are restored
+	check(has(foo->clobbered, 5) && !has(foo->preserved, 5), "convention: unknown overwritten is clobbered");
+	check(has(foo->preserved, 3) && has(foo->preserved, 4), "convention: spilled registers preserved");
+
+	// main has its unknown return address survive both calls, as foo preserves r6, but not r5
+	const conv::Function& main = &functions[0] == foo ? functions[1] : functions[0];
+	check(has(main.preserved, 6) && has(main.clobbered, 5), "convention: calls stepped over as per the callee");
+
+	std::vector< conv::Candidate > candidates;
+	conv::rankSpills(functions, candidates);
+	check(2 == candidates.size() && &functions[candidates[0].function] == foo && 0 == candidates[0].spill &&
+		4 == candidates[0].yield, "convention: unused spill ranked first");
+}
+
+// a function saving a register in its prologue and reusing it on one side of a diamond only; the pair should move into
+// that side, the image should get relocated around the grown BB with its branch targets patched, and the fresh CFG should
+// be laid out without overlaps and solved anew, the moved pair balancing 'storage' at the join
+void checkShrinkWrap()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0xc00;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(4, 5), makeLoad(1, 0xc05), makeLoad(2, 0xc04), makeInstr(op_br, 1),     // call foo
+		makeInstr(op_br, 6),                                                               // 0xc04: return
+		makeInstr(op_push, 4), makeLoad(5, 0xc0a), makeInstr(op_cbr, 5, 6, 6),            // 0xc05: foo
+		makeLoad(5, 0xc0c), makeInstr(op_br, 5),                                           // 0xc08: path around r4
+		makeLoad(4, 1), makeInstr(op_op2, 3, 4),                                           // 0xc0a: path reusing r4
+		makeInstr(op_pop, 4), makeInstr(op_br, 2)                                          // 0xc0c: join, return
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+	conv::Functions functions;
+	if (!image::load(image, graph) || !graph.solve(image.base) || !conv::recognise(graph, functions, image.base, 6)) {
+		check(false, "wrap: analysis");
+		return;
+	}
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > wrapped;
+	image::Image wrappedImage;
+	reloc::AddressMap map;
+	wrap::Result result;
+	if (!wrap::shrinkWrap(graph, functions, image.base, wrapped, wrappedImage, map, result)) {
+		check(false, "wrap: shrink-wrapped");
+		return;
+	}
+
+	check(0 == result.removed && 1 == result.moved && 14 == wrappedImage.instr.size(), "wrap: pair moved");
+	check(op_push == wrappedImage.instr[9].getOpcode() && 4 == wrappedImage.instr[9].getOperand(0) &&
+		op_pop == wrappedImage.instr[12].getOpcode() && 4 == wrappedImage.instr[12].getOperand(0),
+		"wrap: pair moved around the reuse");
+	check(0xc09 == wrappedImage.instr[5].getImm() && 0xc0d == wrappedImage.instr[7].getImm(),
+		"wrap: branch targets patched");
+
+	// BBs back to back, with no overlaps and no gaps
+	bb::Address next = wrappedImage.base;
+	size_t size = 0;
+	bool packed = true;
+	for (const auto& it : wrapped) {
+		packed = packed && uint32_t(next) == uint32_t(it.getStartAddress());
+		next = it.getStartAddress() + bb::Address(it.getSequence().size());
+		size += it.getSequence().size();
+	}
+	check(packed && size == wrappedImage.instr.size(), "wrap: BBs laid out without overlaps");
+
+	// the grown BB falls through to the relocated join, which gets r4 restored on both paths
+	bb::BTB targets;
+	std::vector< uint32_t > values;
+	const auto* const reg = wrapped.getRegistry(0xc0d);
+	const auto* const stack = wrapped.getStack(0xc0d);
+	if (reg)
+		conv::detail::getValues(reg[cfg::order_entry], 4, values);
+
+	check(wrapped.getExitTargets(0xc09, targets) && 1 == targets.size() && 0xc0d == uint32_t(targets[0]),
+		"wrap: grown BB falls through to its successor");
+	check(wrapped.isReached(0xc09) && wrapped.isReached(0xc0d) && reg && stack &&
+		0 == stack[cfg::order_entry].height() && std::vector< uint32_t >(1, 5) == values,
+		"wrap: relocated CFG solved anew");
+}
+
+// a cbr on two constants, and one on a register holding different constants along two paths, the path adding the second
+// constant getting merged last; the first cbr should take only its edge as per the predicate, and the second, decided on
+// the first constant alone at first, should take both edges once the second constant arrives
+void checkPredicate()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0xd00;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(1, 3), makeLoad(2, 3), makeLoad(3, 0xd06), makeInstr(op_cbr, 3, 1, 2), // cbr on 3 and 3
+		makeLoad(4, 1), makeInstr(op_br, 6),                                            // 0xd04: fall-through edge
+		makeLoad(4, 2), makeInstr(op_br, 6)                                             // 0xd06: branch edge
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	const struct {
+		cfg::Predicate predicate;
+		bool taken;
+		bool skipped;
+		const char* name;
+	} cases[] = {
+		{ nullptr, true, true, "predicate: unknown comparison takes both edges" },
+		{ cfg::compareEqual, true, false, "predicate: equal takes the branch edge only" },
+		{ cfg::compareNotEqual, false, true, "predicate: not-equal takes the fall-through edge only" },
+		{ cfg::compareLess, false, true, "predicate: less takes the fall-through edge only" }
+	};
+
+	for (const auto& it : cases) {
+		cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+		graph.setPredicate(it.predicate);
+		bb::BTB targets;
+
+		const bool success = image::load(image, graph) && graph.solve(image.base) && graph.getExitTargets(image.base, targets);
+		check(success && it.taken == graph.isReached(0xd06) && it.skipped == graph.isReached(0xd04) &&
+			size_t(it.taken) + size_t(it.skipped) == targets.size(), it.name);
+	}
+
+	image.base = 0xe00;
+	const Instr widening[] = {
+		makeLoad(1, 3), makeLoad(5, 0xe04), makeInstr(op_cbr, 5, 6, 6), // cbr on unknowns
+		makeLoad(1, 4),                                                  // 0xe03: r1 widened to 4
+		makeLoad(2, 3), makeLoad(3, 0xe08), makeInstr(op_cbr, 3, 1, 2),  // 0xe04: cbr on 3 or 4, and 3
+		makeInstr(op_br, 6),                                             // 0xe07: fall-through edge
+		makeInstr(op_br, 6)                                              // 0xe08: branch edge
+	};
+	image.instr.assign(widening, widening + sizeof(widening) / sizeof(widening[0]));
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+	graph.setPredicate(cfg::compareEqual);
+	check(image::load(image, graph) && graph.solve(image.base) && graph.isReached(0xe03) &&
+		graph.isReached(0xe07) && graph.isReached(0xe08), "predicate: edges added as compared values widen");
+}
+
+// a BB, a registry and two stacks sharing a node accounted on their own, and a CFG spilling a register solved with and
+// without sampling; accounted sizes should match the structures, shared nodes should count once, and the peak should
+// cover the final usage when sampled, and stay clear otherwise
+void checkMemory()
+{
+	using namespace isa;
+
+	bb::BasicBlock block(0xf00);
+	block.addInstr(makeLoad(1, 0xf00));
+	block.addInstr(makeInstr(op_br, 1));
+	const mem::Usage blockUsage = block.validate() ? block.memoryUsage() : mem::Usage();
+	check(2 * sizeof(Instr) == blockUsage.instructions && 0 == blockUsage.registries, "memory: BB accounted");
+
+	reg::BasicRegistry< reg::reg_count_16 > registry;
+	registry.addUnknown(1);
+	registry.addValue(2, 3);
+	registry.addValue(2, 4);
+	const mem::Usage registryUsage = registry.memoryUsage();
+	check(3 * sizeof(reg::Values::value_type) == registryUsage.registries &&
+		3 * mem::tree_node_overhead == registryUsage.overhead, "memory: registry accounted");
+
+	storage::Values bottom(2, reg::Value(1));
+	storage::Values left(1, reg::Value(2));
+	storage::Values right(1, reg::Value(3));
+	const storage::Stack shared = storage::Stack().push(std::move(bottom));
+	const storage::Stack lhs = shared.push(std::move(left));
+	const storage::Stack rhs = shared.push(std::move(right));
+
+	mem::Usage stackUsage;
+	std::unordered_set< const void* > seen;
+	lhs.memoryUsage(stackUsage, seen);
+	rhs.memoryUsage(stackUsage, seen);
+	check(4 * sizeof(reg::Value) == stackUsage.storage &&
+		stackUsage.storage == lhs.memoryUsage().storage + rhs.memoryUsage().storage - shared.memoryUsage().storage,
+		"memory: shared 'storage' nodes accounted once");
+
+	image::Image image;
+	image.base = 0xf00;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(1, 5), makeInstr(op_push, 1), makeLoad(2, 0xf04), makeInstr(op_br, 2), // spill r1
+		makeInstr(op_pop, 1), makeInstr(op_br, 6)                                         // 0xf04: fill r1, return
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	for (size_t sampling = 0; sampling < 2; ++sampling) {
+		cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+		graph.setMemorySampling(sampling);
+		if (!image::load(image, graph) || !graph.solve(image.base)) {
+			check(false, "memory: analysis");
+			return;
+		}
+
+		const mem::Usage usage = graph.memoryUsage();
+		const mem::Usage& peak = graph.getPeakMemoryUsage();
+		check(image.instr.size() * sizeof(Instr) == usage.instructions && 0 != usage.registries && 0 != usage.storage,
+			"memory: CFG accounted");
+		check(sampling ? peak.total() >= usage.total() && 0 != peak.storage : 0 == peak.total(),
+			sampling ? "memory: peak sampled" : "memory: peak clear without sampling");
+
+		graph.setMemorySampling(sampling);
+		check(0 == graph.getPeakMemoryUsage().total(), "memory: peak reset");
+	}
+}
+
+// an image written out and read back, followed by raw encodings of no valid instruction; the image should be written in
+// the file format, read back as written, and the invalid encodings -- the reserved opcode bit included -- should decode to invalid instructions
+void checkImageFile()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0x500;
+	image.args.push_back(6);
+
+	const Instr program[] = { makeLoad(1, 0x7fff), makeInstr(op_op3, 2, 1, 1), makeInstr(op_push, 2), makeInstr(op_br, 6) };
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	FILE* const f = tmpfile();
+	image::Image readBack;
+	uint8_t bytes[20];
+	const bool success = image::write(f, image) && 0 == fseek(f, 0, SEEK_SET) && 1 == fread(bytes, sizeof(bytes), 1, f) &&
+		0 == fseek(f, 0, SEEK_SET) && image::read(f, readBack);
+	fclose(f);
+
+	// header and first instruction as LE words, the instruction as operands r0..r2 followed by the opcode
+	const uint8_t expected[] = { 0x44, 0x53, 0x50, 0x4c, 0x00, 0x05, 0x00, 0x00, 4, 0, 0, 0, 1, 0, 0, 0, 1, 0xff, 0x7f, op_li };
+	check(success && 0 == memcmp(bytes, expected, sizeof(expected)), "image: written in the file format");
+
+	check(success && readBack.base == image.base && readBack.args == image.args &&
+		readBack.instr.size() == image.instr.size(), "image: read back as written");
+
+	for (size_t i = 0; success && i < image.instr.size(); ++i) {
+		check(readBack.instr[i].getOpcode() == image.instr[i].getOpcode() &&
+			readBack.instr[i].getOperand(0) == image.instr[i].getOperand(0) &&
+			readBack.instr[i].getOperand(1) == image.instr[i].getOperand(1) &&
+			readBack.instr[i].getOperand(2) == image.instr[i].getOperand(2), "image: instructions read back as written");
+	}
+
+	check(op_br == decodeInstr(0x04ffff06).getOpcode(), "image: valid encoding decoded");
+	check(op_invalid == decodeInstr(0x84ffff06).getOpcode(), "image: reserved opcode bit rejected");
+	check(op_invalid == decodeInstr(0x04ff0706).getOpcode(), "image: excess operands rejected");
+}
+
+// a program loading a BB start both as a branch target, directly and via 'storage', and as data, relocated past a
+// dropped nop, and a CFG branching into the middle of a BB; only the branch-target loads should get patched, and the
+// latter should fail to relocate
+void checkRelocation()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0x600;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(1, 0x605), makeLoad(2, 0x605), makeInstr(op_nop), makeInstr(op_op2, 3, 2), makeInstr(op_br, 1),
+		makeLoad(5, 0x609), makeInstr(op_push, 5), makeInstr(op_pop, 7), makeInstr(op_br, 7), // 0x605
+		makeInstr(op_br, 6)                                                                     // 0x609
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > graph;
+	if (!image::load(image, graph) || !graph.solve(image.base)) {
+		check(false, "reloc: analysis");
+		return;
+	}
+
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > relocated;
+	image::Image relocatedImage;
+	reloc::AddressMap map;
+	if (!reloc::relocate(graph, relocated, relocatedImage, map) || 9 != relocatedImage.instr.size()) {
+		check(false, "reloc: relocation");
+		return;
+	}
+
+	check(0x604 == relocatedImage.instr[0].getImm(), "reloc: branch-target load patched");
+	check(0x605 == relocatedImage.instr[1].getImm(), "reloc: data load left intact");
+	check(0x608 == relocatedImage.instr[4].getImm(), "reloc: branch-target load via 'storage' patched");
+
+	reg::BasicRegistry< reg::reg_count_16 > reg;
+	reg.addUnknown(6);
+	check(relocated.setRegistry(relocatedImage.base, std::move(reg)) && relocated.solve(relocatedImage.base) &&
+		relocated.isReached(0x608), "reloc: relocated CFG solved through patched targets");
+
+	// a branch into the middle of a BB, as in a CFG not split at all loaded immediates, has no new address to patch in
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > split;
+	bb::BasicBlock entry(0x680);
+	bb::BasicBlock body(0x682);
+	entry.addInstr(makeLoad(1, 0x684));
+	entry.addInstr(makeInstr(op_br, 1));
+	for (size_t i = 0; i < 3; ++i)
+		body.addInstr(makeInstr(op_op2, 3, 6));
+	body.addInstr(makeInstr(op_br, 6));
+
+	reg::BasicRegistry< reg::reg_count_16 > splitReg;
+	splitReg.addUnknown(6);
+	cfg::BasicControlFlowGraph< reg::reg_count_16 > splitRelocated;
+	check(entry.validate() && body.validate() && split.addBasicBlock(std::move(entry)) && split.addBasicBlock(std::move(body)) &&
+		split.setRegistry(0x680, std::move(splitReg)) && split.solve(0x680) &&
+		!reloc::relocate(split, splitRelocated, relocatedImage, map), "reloc: branch target past a BB start rejected");
+}
+
+// BBs saving and restoring registers around their bodies, the same register and another one; the pair restoring the
+// same register, not written in between, should fold away from the transfer summary, and the summaries should leave
+// the same state as the instruction walk
+void checkTransfer()
+{
+	using namespace isa;
+	typedef cfg::BasicControlFlowGraph< reg::reg_count_16 > ControlFlowGraph;
+
+	image::Image image;
+	image.base = 0x800;
+	image.args.push_back(2);
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(1, 7), makeInstr(op_push, 1), makeInstr(op_push, 2), makeLoad(2, 3), makeInstr(op_op2, 3, 2),
+		makeInstr(op_pop, 2), makeInstr(op_pop, 1), makeLoad(5, 0x809), makeInstr(op_br, 5),
+		makeInstr(op_push, 1), makeInstr(op_pop, 4), makeInstr(op_br, 6) // 0x809
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	ControlFlowGraph graph;
+	if (!image::load(image, graph) || !graph.solve(image.base)) {
+		check(false, "transfer: analysis");
+		return;
+	}
+
+	const struct {
+		bb::Address start;
+		size_t steps;
+	} cases[] = {
+		{ 0x800, 5 }, // li r1, push r2, op r3, pop r2, li r5
+		{ 0x809, 2 }  // push r1, pop r4
+	};
+
+	for (const auto& it : cases) {
+		for (const auto& jt : graph) {
+			if (uint32_t(jt.getStartAddress()) == uint32_t(it.start))
+				check(it.steps == jt.xfer.steps.size(), "transfer: same-register push-pop pairs folded");
+		}
+
+		ControlFlowGraph::Registry reg = graph.getRegistry(it.start)[cfg::order_entry];
+		ControlFlowGraph::Stack stack = graph.getStack(it.start)[cfg::order_entry];
+		bb::Address addr = it.start;
+
+		bool success = true;
+		for (const auto& jt : graph.getBasicBlock(it.start)->getSequence())
+			success = success && ControlFlowGraph::transfer(jt, addr++, reg, stack);
+
+		check(success && isSameRegistry(reg, graph.getRegistry(it.start)[cfg::order_exit]) &&
+			stack.height() == graph.getStack(it.start)[cfg::order_exit].height(), "transfer: summary as per instruction walk");
+	}
+}
+
+// states within a BB queried via checkpoints, before and after an edit of the BB; every query should match the
+// instruction walk up to the queried address, and the checkpoints should take accounted memory
+void checkCheckpoints()
+{
+	using namespace isa;
+	typedef cfg::BasicControlFlowGraph< reg::reg_count_16 > ControlFlowGraph;
+
+	image::Image image;
+	image.base = 0x900;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(0, 1), makeLoad(1, 2), makeInstr(op_push, 0), makeLoad(2, 3), makeInstr(op_op3, 3, 1, 2),
+		makeInstr(op_pop, 4), makeLoad(0, 5), makeInstr(op_push, 1), makeLoad(1, 6), makeInstr(op_pop, 5), makeInstr(op_br, 6)
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	ControlFlowGraph graph;
+	if (!image::load(image, graph) || !graph.solve(image.base)) {
+		check(false, "checkpoints: analysis");
+		return;
+	}
+
+	const size_t before = graph.memoryUsage().registries;
+	graph.setCheckpointInterval(3);
+
+	for (size_t edit = 0; edit < 2; ++edit) {
+		if (edit)
+			graph.getBasicBlock(image.base)->replaceInstr(3, makeLoad(2, 9));
+
+		ControlFlowGraph::Registry walkReg = graph.getRegistry(image.base)[cfg::order_entry];
+		ControlFlowGraph::Stack walkStack = graph.getStack(image.base)[cfg::order_entry];
+		const bb::Instructions& seq = graph.getBasicBlock(image.base)->getSequence();
+
+		for (size_t i = 0; i < seq.size(); ++i) {
+			ControlFlowGraph::Registry reg;
+			ControlFlowGraph::Stack stack;
+			check(graph.getRegistryAt(image.base + bb::Address(i), reg, stack) && isSameRegistry(reg, walkReg) &&
+				stack.height() == walkStack.height(), "checkpoints: state as per instruction walk");
+
+			ControlFlowGraph::transfer(seq[i], image.base + bb::Address(i), walkReg, walkStack);
+		}
+	}
+
+	check(graph.memoryUsage().registries > before, "checkpoints: memory accounted");
+}
+
+// demand-driven queries on a CFG already solved for another entry state, with a BB unreached from the entry; the solved
+// state should stay as found until demanded, demanded BBs should get their registries as per a full solve for the new
+// entry state, and the unreached BB should get none
+void checkDemand()
+{
+	using namespace isa;
+	typedef cfg::BasicControlFlowGraph< reg::reg_count_16 > ControlFlowGraph;
+
+	image::Image image;
+	image.base = 0xa00;
+	image.args.push_back(6); // LR of the program
+	image.args.push_back(7);
+
+	const Instr program[] = {
+		makeLoad(0, 3), makeLoad(1, 0xa05), makeInstr(op_br, 1),
+		makeLoad(0, 4), makeInstr(op_op2, 2, 0),                 // 0xa03: unreached, falls through
+		makeInstr(op_op2, 3, 0), makeInstr(op_br, 6)              // 0xa05
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	ControlFlowGraph graph;
+	if (!image::load(image, graph) || !graph.solve(image.base)) {
+		check(false, "demand: analysis");
+		return;
+	}
+
+	// the reference -- a full solve without r7 at entry
+	ControlFlowGraph full;
+	image::Image narrow = image;
+	narrow.args.pop_back();
+	if (!image::load(narrow, full) || !full.solve(narrow.base)) {
+		check(false, "demand: reference analysis");
+		return;
+	}
+
+	demand::BasicAnalysis< reg::reg_count_16 > analysis(graph);
+	check(graph.isReached(0xa05) && graph.getRegistry(0xa05)[cfg::order_entry].occupied(7), "demand: solved state left as found");
+
+	ControlFlowGraph::Registry reg;
+	reg.addUnknown(6);
+	check(analysis.setEntry(image.base, std::move(reg)), "demand: entry set");
+
+	const ControlFlowGraph::Registry* const demanded = analysis.getRegistry(0xa05);
+	check(demanded && isSameRegistry(demanded[cfg::order_entry], full.getRegistry(0xa05)[cfg::order_entry]) &&
+		isSameRegistry(demanded[cfg::order_exit], full.getRegistry(0xa05)[cfg::order_exit]), "demand: registries as per full solve");
+	check(analysis.isSolved(0xa00) && analysis.isSolved(0xa05), "demand: dependencies solved");
+
+	check(!analysis.getRegistry(0xa03), "demand: unreached BB gets no registry");
+	check(!analysis.getRegistry(0xa03), "demand: unreached BB gets no registry once solved");
+	check(!analysis.getRegistry(0xb00), "demand: unknown BB gets no registry");
+
+	// retarget the branch to the unreached BB; once reset, the analysis should follow the new edge
+	image.instr[1] = makeLoad(1, 0xa03);
+	narrow.instr[1] = image.instr[1];
+	bb::BasicBlock* const block = graph.getBasicBlock(image.base);
+	block->replaceInstr(1, image.instr[1]);
+
+	ControlFlowGraph edited;
+	if (!block->validate() || !image::load(narrow, edited) || !edited.solve(narrow.base)) {
+		check(false, "demand: edited analysis");
+		return;
+	}
+
+	// the edited image has 0xa05 no longer loaded, so no BB starts there; compare registries before it instead
+	ControlFlowGraph::Registry joinedReg;
+	ControlFlowGraph::Stack joinedStack;
+	analysis.reset();
+	const ControlFlowGraph::Registry* const retargeted = analysis.getRegistry(0xa03);
+	const ControlFlowGraph::Registry* const joined = analysis.getRegistry(0xa05);
+	check(retargeted && edited.getRegistry(0xa03) &&
+		isSameRegistry(retargeted[cfg::order_entry], edited.getRegistry(0xa03)[cfg::order_entry]) &&
+		joined && edited.getRegistryAt(0xa05, joinedReg, joinedStack) && isSameRegistry(joined[cfg::order_entry], joinedReg),
+		"demand: retargeted branch followed after reset");
+}
+
+// blocks of a pool freed by threads other than their allocating ones, and left over by exiting threads; the former should
+// get recycled by the freeing thread, the latter by the next thread running out of blocks
+void checkPool()
+{
+	typedef mem::Pool< 200, 8 > Pool;
+
+	void* p = nullptr;
+	std::thread([&]() { p = Pool::allocate(); }).join();
+	Pool::deallocate(p);
+	check(p == Pool::allocate(), "pool: block freed by another thread recycled");
+	Pool::deallocate(p);
+
+	void* q = nullptr;
+	void* r = nullptr;
+	std::thread([&]() { q = Pool::allocate(); Pool::deallocate(q); }).join();
+	std::thread([&]() { r = Pool::allocate(); Pool::deallocate(r); }).join();
+	check(q == r, "pool: blocks of an exited thread taken over");
+
+	// registries built on a worker and dropped on this thread
+	std::vector< reg::BasicRegistry< reg::reg_count_16 > > registries(16);
+	std::thread([&]() {
+		for (size_t i = 0; i < registries.size(); ++i) {
+			for (reg::Register r = 0; r < reg::reg_count_16; ++r)
+				registries[i].addValue(r, uint32_t(i));
+		}
+	}).join();
+
+	std::vector< uint32_t > values;
+	conv::detail::getValues(registries.back(), 15, values);
+	check(values == std::vector< uint32_t >(1, 15), "pool: registry built on a worker");
+	registries.clear();
+}
+
+// an image processed by the driver and emitted to a missing directory, then to an existing one; the former should fail
+// without emitting, the latter should emit the image and its address map
+void checkDriver()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0x700;
+	image.args.push_back(6);
+
+	const Instr program[] = { makeLoad(1, 0x703), makeInstr(op_nop), makeInstr(op_br, 1), makeInstr(op_br, 6) };
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	char dir[] = "/tmp/despillXXXXXX";
+	if (!mkdtemp(dir)) {
+		check(false, "driver: temp directory");
+		return;
+	}
+
+	const std::string path = std::string(dir) + "/in.img";
+	FILE* const f = fopen(path.c_str(), "wb");
+	const bool written = f && image::write(f, image);
+	if (f)
+		fclose(f);
+
+	check(written, "driver: input image written");
+
+	const std::string missing = std::string(dir) + "/missing";
+	const std::string out = std::string(dir) + "/out";
+	mkdir(out.c_str(), 0700);
+
+	driver::Worker worker;
+	driver::Outcome outcome;
+	check(!driver::process(path.c_str(), missing.c_str(), 1, nullptr, worker, outcome), "driver: missing output directory fails");
+	check(driver::process(path.c_str(), out.c_str(), 1, nullptr, worker, outcome) && 3 == outcome.instrEmitted,
+		"driver: image processed");
+
+	image::Image emitted;
+	FILE* const g = fopen((out + "/in.img").c_str(), "rb");
+	check(g && image::read(g, emitted) && 3 == emitted.instr.size() && 0x702 == emitted.instr[0].getImm(),
+		"driver: compacted image emitted");
+	if (g)
+		fclose(g);
+
+	FILE* const h = fopen((out + "/in.img.map").c_str(), "r");
+	check(h, "driver: address map emitted");
+	if (h)
+		fclose(h);
+
+	// an image claiming reg-invalid as an arg should fail on its own, rather than take the batch down with it
+	image::Image bad = image;
+	bad.args.push_back(reg_invalid);
+
+	const std::string badPath = std::string(dir) + "/bad.img";
+	FILE* const b = fopen(badPath.c_str(), "wb");
+	const bool badWritten = b && image::write(b, bad);
+	if (b)
+		fclose(b);
+
+	image::Image badReadBack;
+	FILE* const c = badWritten ? fopen(badPath.c_str(), "rb") : nullptr;
+	check(c && !image::read(c, badReadBack), "driver: reg-invalid arg rejected on read");
+	if (c)
+		fclose(c);
+
+	check(!driver::process(badPath.c_str(), nullptr, 1, nullptr, worker, outcome), "driver: reg-invalid arg image fails");
+
+	char* argv[] = { const_cast< char* >("despill"), const_cast< char* >(badPath.c_str()), const_cast< char* >(path.c_str()) };
+	check(1 == driver::run(3, argv), "driver: batch survives a reg-invalid arg image");
+
+	remove(badPath.c_str());
+	remove((out + "/in.img").c_str());
+	remove((out + "/in.img.map").c_str());
+	rmdir(out.c_str());
+	remove(path.c_str());
+	rmdir(dir);
+}
+
+// a server run on a thread at a temp socket, queried by a client over two connections in turn; edits keeping the BB
+// boundaries, in a BB past the entry and in the entry, should get re-solved in place, invalid encodings rejected, and an
+// edit adding a branch target should split BBs and get analysed anew
+void checkServer()
+{
+	using namespace isa;
+
+	image::Image image;
+	image.base = 0x1000;
+	image.args.push_back(6); // LR of the program
+
+	const Instr program[] = {
+		makeLoad(1, 5), makeLoad(2, 0x1003), makeInstr(op_br, 2), // jump over
+		makeInstr(op_op2, 3, 1), makeInstr(op_br, 6)              // 0x1003: return
+	};
+	image.instr.assign(program, program + sizeof(program) / sizeof(program[0]));
+
+	char dir[] = "/tmp/despillXXXXXX";
+	if (!mkdtemp(dir)) {
+		check(false, "server: temp directory");
+		return;
+	}
+
+	const std::string path = std::string(dir) + "/in.img";
+	const std::string socketPath = std::string(dir) + "/socket";
+	FILE* const f = fopen(path.c_str(), "wb");
+	const bool written = f && image::write(f, image);
+	if (f)
+		fclose(f);
+
+	check(written, "server: input image written");
+
+	server::Server srv;
+	std::thread serving([&]() { srv.serve(socketPath.c_str()); });
+
+	server::Client client;
+	bool connected = false;
+	for (size_t i = 0; i < 100 && !(connected = client.connect(socketPath.c_str())); ++i)
+		usleep(10000);
+
+	check(connected, "server: connected");
+
+	uint32_t id = 0;
+	size_t blockCount = 0;
+	size_t height = 0;
+	std::vector< server::RegValue > values;
+	std::vector< server::Block > blocks;
+
+	const auto valuesOf = [&](const reg::Register r) {
+		std::vector< uint32_t > res;
+		for (const auto& it : values) {
+			if (r == it.first)
+				res.push_back(it.second);
+		}
+		return res;
+	};
+
+	check(connected && client.load(path.c_str(), id, blockCount) && 0 == id && 2 == blockCount, "server: image loaded");
+	check(client.registry(id, 0x1004, height, values) && 0 == height && std::vector< uint32_t >(1, 5) == valuesOf(1) &&
+		std::vector< uint32_t >(1, 0x80000000) == valuesOf(3), "server: registry queried");
+
+	Instr load = makeLoad(3, 9);
+	check(client.edit(id, 0x1003, load, blockCount) && 2 == blockCount && client.registry(id, 0x1004, height, values) &&
+		std::vector< uint32_t >(1, 5) == valuesOf(1) && std::vector< uint32_t >(1, 9) == valuesOf(3),
+		"server: edit past the entry re-solved");
+
+	load = makeLoad(1, 7);
+	check(client.edit(id, 0x1000, load, blockCount) && 2 == blockCount && client.registry(id, 0x1004, height, values) &&
+		std::vector< uint32_t >(1, 7) == valuesOf(1) && std::vector< uint32_t >(1, 9) == valuesOf(3),
+		"server: edit of the entry re-solved");
+
+	check(!client.editRaw(id, 0x1000, 0x80000000, blockCount) && "invalid instruction" == client.getError() &&
+		!client.editRaw(id, 0x1000, 0x7f000000, blockCount) && !client.editRaw(id, 0x2000, encodeInstr(load), blockCount),
+		"server: invalid edits rejected");
+
+	load = makeLoad(2, 0x1004);
+	check(client.edit(id, 0x1001, load, blockCount) && 3 == blockCount && client.blocks(id, blocks) && 3 == blocks.size() &&
+		0x1003 == blocks[1].start && !blocks[1].reached && blocks[2].reached, "server: edit splitting BBs analysed anew");
+
+	client.disconnect();
+
+	server::Client other;
+	check(other.connect(socketPath.c_str()) && other.shutdown(), "server: shut down from another connection");
+	serving.join();
+
+	remove(path.c_str());
+	rmdir(dir);
+}
+
+int main(int argc, char** argv)
+{
+	// given any args, act as a batch driver; otherwise run the demo
+	if (argc > 1)
+		return driver::run(argc, argv);
+
 	fprintf(stdout, "sizeof(Instr): %lu\nsizeof(BasicBlock): %lu\nsizeof(ControlFlowGraph): %lu\nsizeof(Registry): %lu\n\n",
 		sizeof(isa::Instr),
 		sizeof(bb::BasicBlock),
@@ -132,8 +1319,7 @@ int main(int, char **)
 		print(stdout, block);
 	}
 
-	using namespace cfg;
-	ControlFlowGraph graph; // full-program CFG
+	std::vector< BasicBlock > program; // full program, BB by BB
 
 	// compose 'int main()' of two basic blocks..
 	const Address addrMain_0 = 0x7000;
@@ -167,8 +1353,7 @@ int main(int, char **)
 		}
 		const bool valid = block.validate();
 		assert(valid);
-		const bool success = graph.addBasicBlock(std::move(block));
-		assert(success);
+		program.push_back(std::move(block));
 	}
 	const Address addrMain_1 = 0x7004;
 	// second basic block -- once our callee is done we return to our caller
@@ -187,8 +1372,7 @@ int main(int, char **)
 		}
 		const bool valid = block.validate();
 		assert(valid);
-		const bool success = graph.addBasicBlock(std::move(block));
-		assert(success);
+		program.push_back(std::move(block));
 	}
 
 	// compose 'int foo()' of one basic block
@@ -224,71 +1408,225 @@ int main(int, char **)
 		}
 		const bool valid = block.validate();
 		assert(valid);
-		const bool success = graph.addBasicBlock(std::move(block));
-		assert(success);
+		program.push_back(std::move(block));
 	}
 
-	// print out the BBs
-	const AddressColor color[] = {
-		addrcolor_one,
-		addrcolor_two
-	};
+	// pick the narrowest GPR file the program fits in, and carry out the rest with a CFG specialised for it
+	size_t regCount = 0;
+	for (const auto& it : program)
+		regCount = std::max(regCount, getRegCount(it.getSequence()));
 
-	size_t colorAlt = 0;
+	// the program in its compact form, for the streaming analysis
+	const image::Image programImage = makeImage(program);
 
-	Address lastEnd = addr_invalid;
-	for (const auto it : graph) {
-		// print a gap at each address discontinuity
-		const Address bbStart = it.getStartAddress();
-		if (bbStart != lastEnd)
-			fputc('\n', stdout);
-		lastEnd = bbStart + Address(it.getSequence().size());
-		print(stdout, it, color[colorAlt]);
-		colorAlt ^= 1;
-	}
+	const int demo = reg::dispatch(regCount, [&](auto width) -> int {
+		constexpr size_t RegCount = decltype(width)::value;
+		fprintf(stdout, "\nregister count: %lu, register-file width: %lu\n", regCount, RegCount);
 
-	// perform CFG analysis (BBs and their order are preset as no automated CFG traversal yet)
-	using namespace reg;
+		using namespace cfg;
+		typedef BasicControlFlowGraph< RegCount > ControlFlowGraph;
+		ControlFlowGraph graph; // full-program CFG
 
-	graph.stackClear();
-	// set up at-entry registry for 'int main()' and compute at-exit registry
-	{
-		Registry reg;
-		reg.addUnknown(127); // our main takes just an LR as an arg
-		bool success = graph.setRegistry(addrMain_0, std::move(reg));
-		assert(success);
-		success = graph.calcRegistry(addrMain_0);
-		assert(success);
-	}
-	// set up at-entry registry for 'int foo()' and compute at-exit registry
-	{
-		Registry reg(graph.getRegistry(addrMain_0)[order_exit]);
-		bool success = graph.setRegistry(addrFoo, std::move(reg));
-		assert(success);
-		success = graph.calcRegistry(addrFoo);
-		assert(success);
-	}
-	// set up at-entry registry for 'int main():past-callee' and compute at-exit registry
-	{
-		Registry reg(graph.getRegistry(addrFoo)[order_exit]);
-		bool success = graph.setRegistry(addrMain_1, std::move(reg));
-		assert(success);
-		success = graph.calcRegistry(addrMain_1);
-		assert(success);
-	}
-
-	// print out the BB registries
-	lastEnd = addr_invalid;
-	for (const auto it : graph) {
-		// print a gap at each address discontinuity
-		const Address bbStart = it.getStartAddress();
-		if (bbStart != lastEnd)
-			fputc('\n', stdout);
-		lastEnd = bbStart + Address(it.getSequence().size());
-		const Registry* const reg = graph.getRegistry(bbStart);
-		print(stdout, reg[order_entry], bbStart);
-		print(stdout, reg[order_exit], lastEnd - 1);
-	}
-
-	return 0;
+		for (auto& it : program) {
+			const bool success = graph.addBasicBlock(std::move(it));
+			assert(success);
+		}
+
+		// print out the BBs
+		const AddressColor color[] = {
+			addrcolor_one,
+			addrcolor_two
+		};
+
+		size_t colorAlt = 0;
+
+		Address lastEnd = addr_invalid;
+		for (const auto it : graph) {
+			// print a gap at each address discontinuity
+			const Address bbStart = it.getStartAddress();
+			if (bbStart != lastEnd)
+				fputc('\n', stdout);
+			lastEnd = bbStart + Address(it.getSequence().size());
+			print(stdout, it, color[colorAlt]);
+			colorAlt ^= 1;
+		}
+
+		// perform CFG analysis -- traverse the CFG from the entry of 'int main()', merging registries at joins
+		// set up at-entry registry for 'int main()' and compute the at-exit registries of all reachable BBs
+		{
+			typename ControlFlowGraph::Registry reg;
+			reg.addUnknown(127); // our main takes just an LR as an arg
+			bool success = graph.setRegistry(addrMain_0, std::move(reg));
+			assert(success);
+			graph.setMemorySampling(1);
+			success = graph.solve(addrMain_0);
+			assert(success);
+		}
+
+		// print out the memory taken by the CFG, heap included, now and at its peak during analysis
+		fprintf(stdout, "\nCFG memory usage:\n");
+		mem::print(stdout, graph.memoryUsage());
+		fprintf(stdout, "\nCFG peak memory usage:\n");
+		mem::print(stdout, graph.getPeakMemoryUsage());
+
+		// print out the BB registries
+		lastEnd = addr_invalid;
+		for (const auto it : graph) {
+			// print a gap at each address discontinuity
+			const Address bbStart = it.getStartAddress();
+			if (bbStart != lastEnd)
+				fputc('\n', stdout);
+			lastEnd = bbStart + Address(it.getSequence().size());
+			const typename ControlFlowGraph::Registry* const reg = graph.getRegistry(bbStart);
+			print(stdout, reg[order_entry], bbStart);
+			print(stdout, reg[order_exit], lastEnd - 1);
+		}
+
+		// recognise functions and infer their calling conventions; 'int main()' gets its LR from outside
+		conv::Functions functions;
+		{
+			const bool success = conv::recognise(graph, functions, addrMain_0, 127);
+			assert(success);
+
+			for (const auto& fn : functions) {
+				fprintf(stdout, "\nfunction %08x: LR %04x, %lu call sites, %lu returns\npreserved {", uint32_t(fn.entry), fn.link,
+					fn.callSites.size(), fn.returns.size());
+				for (const auto it : fn.preserved)
+					fprintf(stdout, " %04x", it);
+				fprintf(stdout, " }\nclobbered {");
+				for (const auto it : fn.clobbered)
+					fprintf(stdout, " %04x", it);
+				fprintf(stdout, " }\n");
+			}
+
+			std::vector< conv::Candidate > candidates;
+			conv::rankSpills(functions, candidates);
+
+			fprintf(stdout, "\nspill candidates by yield:\n");
+			for (const auto& it : candidates) {
+				const conv::Spill& spill = functions[it.function].spills[it.spill];
+				fprintf(stdout, "%04x at %08x: %s, yield %lu\n", spill.reg, uint32_t(spill.push),
+					spill.used ? "used" : "unused", it.yield);
+			}
+		}
+
+		// query the registry in the middle of a BB -- right before 'int foo()' restores its LR
+		{
+			typename ControlFlowGraph::Registry reg;
+			typename ControlFlowGraph::Stack stack;
+			graph.setCheckpointInterval(2);
+			const bool success = graph.getRegistryAt(addrFoo + Address(2), reg, stack);
+			assert(success);
+			fprintf(stdout, "\nregistry at instr, storage height %lu:\n", stack.height());
+			print(stdout, reg, addrFoo + Address(2));
+		}
+
+		// redo the CFG analysis in streaming mode -- from the compact program image, one region at a time, in topological
+		// order, evicting each region once done and spilling its registries to a file
+		{
+			using namespace stream;
+			FILE* const spill = tmpfile();
+			BasicAnalyser< RegCount > analyser(programImage, spill);
+			{
+				typename ControlFlowGraph::Registry reg;
+				reg.addUnknown(127); // our main takes just an LR as an arg
+				const bool success = analyser.setEntry(addrMain_0, std::move(reg)) && analyser.analyse();
+				assert(success);
+			}
+
+			// print out the region summaries
+			fprintf(stdout, "\nstreaming peak resident BBs: %lu, bytes: %lu\n", analyser.getPeakResident(),
+				analyser.getPeakMemoryUsage().total());
+			for (size_t i = 0; i < analyser.getRegions().size(); ++i) {
+				const typename BasicAnalyser< RegCount >::Summary& summary = analyser.getSummaries()[i];
+				fprintf(stdout, "region %08x: rank %lu, %lu BBs, %lu passes\n", uint32_t(summary.entry),
+					analyser.getRegions()[i].rank, summary.blockCount, summary.passes);
+				if (summary.passes)
+					print(stdout, summary.exit, summary.entry);
+			}
+
+			// print out the BB registries as read back from the spill file -- the last record of each BB counts
+			std::map< uint32_t, std::pair< typename ControlFlowGraph::Registry, typename ControlFlowGraph::Registry > > spilled;
+			rewind(spill);
+
+			Address start = addr_invalid;
+			typename ControlFlowGraph::Registry reg[order__count];
+			while (readSpilledBlock(spill, start, reg))
+				spilled[start] = std::make_pair(reg[order_entry], reg[order_exit]);
+
+			fclose(spill);
+
+			fprintf(stdout, "\nstreamed registries:\n");
+			for (const auto& it : spilled) {
+				print(stdout, it.second.first, it.first);
+				print(stdout, it.second.second, it.first);
+				check(isSameRegistry(it.second.first, graph.getRegistry(it.first)[order_entry]) &&
+					isSameRegistry(it.second.second, graph.getRegistry(it.first)[order_exit]), "demo: streamed registries as per resident ones");
+			}
+		}
+
+		// freeze the CFG and look for redundant loads in the frozen form
+		{
+			const csr::BasicFrozenGraph< RegCount > frozen(graph);
+			std::vector< Address > loads;
+			const size_t count = opt::findRedundantLoads(frozen, addrMain_0, loads);
+			fprintf(stdout, "\nfrozen CFG of %lu BBs, redundant loads found: %lu\n", frozen.getBlockCount(), count);
+		}
+
+		// eliminate loads of constants already present in their destination registers
+		fprintf(stdout, "\nredundant loads eliminated: %lu\n", opt::eliminateRedundantLoads(graph, addrMain_0));
+
+		// shrink-wrap save/restore pairs -- remove the unused ones, and sink the rest into the regions that need them --
+		// and compact the program -- drop nops, pack BBs, and patch branch targets
+		{
+			ControlFlowGraph relocated;
+			image::Image image;
+			reloc::AddressMap map;
+			wrap::Result result;
+			const bool success = wrap::shrinkWrap(graph, functions, addrMain_0, relocated, image, map, result);
+			assert(success);
+
+			fprintf(stdout, "\nsave/restore pairs removed: %lu, moved: %lu\n", result.removed, result.moved);
+
+			fprintf(stdout, "\nrelocated BBs:\n");
+			reloc::writeAddressMap(stdout, map);
+
+			colorAlt = 0;
+			lastEnd = addr_invalid;
+			for (const auto& it : relocated) {
+				// print a gap at each address discontinuity
+				const Address bbStart = it.getStartAddress();
+				if (bbStart != lastEnd)
+					fputc('\n', stdout);
+				lastEnd = bbStart + Address(it.getSequence().size());
+				print(stdout, it, color[colorAlt]);
+				colorAlt ^= 1;
+			}
+		}
+
+		return 0;
+	});
+
+	checkStreaming();
+	checkStorage();
+	checkWidths();
+	checkRedundantLoads();
+	checkFrozen();
+	checkBuilder();
+	checkBulk();
+	checkConvention();
+	checkShrinkWrap();
+	checkPredicate();
+	checkMemory();
+	checkImageFile();
+	checkRelocation();
+	checkTransfer();
+	checkCheckpoints();
+	checkDemand();
+	checkPool();
+	checkDriver();
+	checkServer();
+
+	fprintf(stdout, "\nchecks failed: %lu\n", checkFailures);
+	return demo || checkFailures ? 1 : 0;
 }
@@ -0,0 +1,183 @@
+#if !defined(__mem_h)
+#define __mem_h
+
+#include <stddef.h>
+#include <stdio.h>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Memory accounting -- bytes taken by the analysis data structures, heap included, broken down by category; heap blocks
+// are accounted at their requested sizes, allocator rounding and headers aside; and per-thread pools for the nodes of
+// the analysis containers
+
+namespace mem {
+
+// estimated bookkeeping per node of a node-based container (std::set, std::map) -- links and colour
+constexpr size_t tree_node_overhead = 4 * sizeof(void*);
+// estimated bookkeeping per std::make_shared or std::allocate_shared allocation -- the control block
+constexpr size_t shared_overhead = 2 * sizeof(void*);
+
+struct Usage {
+	size_t instructions = 0; // instructions of BBs
+	size_t btb = 0; // branch targets of BBs
+	size_t registries = 0; // values held in registries, checkpoints included
+	size_t storage = 0; // values held in 'storage' stacks, shared nodes counted once
+	size_t summaries = 0; // transfer summaries of BBs
+	size_t overhead = 0; // container bookkeeping -- object bodies, tree nodes, control blocks, and unused capacity
+
+	size_t total() const { return instructions + btb + registries + storage + summaries + overhead; }
+
+	Usage& operator +=(const Usage& oth)
+	{
+		instructions += oth.instructions;
+		btb += oth.btb;
+		registries += oth.registries;
+		storage += oth.storage;
+		summaries += oth.summaries;
+		overhead += oth.overhead;
+		return *this;
+	}
+};
+
+// account the heap block of a vector to a category, its unused capacity to overhead
+template < typename T >
+inline void addVector(const std::vector< T >& vec, size_t& category, Usage& usage)
+{
+	category += vec.size() * sizeof(T);
+	usage.overhead += (vec.capacity() - vec.size()) * sizeof(T);
+}
+
+// print out usage by category, one per line
+inline void print(FILE* f, const Usage& usage)
+{
+	fprintf(f, "instructions: %lu\nBTB: %lu\nregistries: %lu\nstorage: %lu\nsummaries: %lu\noverhead: %lu\ntotal: %lu\n",
+		usage.instructions,
+		usage.btb,
+		usage.registries,
+		usage.storage,
+		usage.summaries,
+		usage.overhead,
+		usage.total());
+}
+
+// pool of fixed-size blocks with a free list per thread, so that threads recycle their blocks without locking, e.g. the
+// workers of a batch; blocks come from chunks that are kept for the lifetime of the process, so a block may be freed by
+// a thread other than the one that allocated it; a thread's free blocks go to a shared list on thread exit, for other
+// threads to take over once their own run out
+template < size_t Size, size_t Align >
+class Pool {
+	union Block {
+		Block* next;
+		alignas(Align) unsigned char storage[Size];
+	};
+
+	// blocks per chunk -- about 64KiB worth
+	static constexpr size_t chunk_blocks = 65536 / sizeof(Block) ? 65536 / sizeof(Block) : 1;
+
+	struct Cache {
+		Block* free = nullptr;
+
+		~Cache()
+		{
+			if (!free)
+				return;
+
+			Block* last = free;
+			while (last->next)
+				last = last->next;
+
+			const std::lock_guard< std::mutex > lock(sharedMutex);
+			last->next = shared;
+			shared = free;
+			free = nullptr;
+		}
+	};
+
+	static inline std::mutex sharedMutex;
+	static inline Block* shared = nullptr;
+	static inline thread_local Cache cache;
+
+	// replenish the free list of the calling thread -- take over the shared list, or else carve a new chunk
+	static void refill(Cache& c)
+	{
+		{
+			const std::lock_guard< std::mutex > lock(sharedMutex);
+			if (shared) {
+				c.free = shared;
+				shared = nullptr;
+				return;
+			}
+		}
+
+		Block* const chunk = static_cast< Block* >(::operator new(chunk_blocks * sizeof(Block)));
+		for (size_t i = 0; i + 1 < chunk_blocks; ++i)
+			chunk[i].next = chunk + i + 1;
+
+		chunk[chunk_blocks - 1].next = nullptr;
+		c.free = chunk;
+	}
+
+public:
+	static void* allocate()
+	{
+		Cache& c = cache;
+		if (!c.free)
+			refill(c);
+
+		Block* const block = c.free;
+		c.free = block->next;
+		return block;
+	}
+
+	static void deallocate(void* const p)
+	{
+		Cache& c = cache;
+		Block* const block = static_cast< Block* >(p);
+		block->next = c.free;
+		c.free = block;
+	}
+};
+
+// allocator of single objects from a per-thread pool of their size, for the nodes of node-based containers (std::map,
+// std::set) and of shared objects (via std::allocate_shared); arrays go to the default allocator
+template < typename T >
+struct PoolAllocator {
+	typedef T value_type;
+
+	PoolAllocator() = default;
+	template < typename U >
+	PoolAllocator(const PoolAllocator< U >&) {}
+
+	T* allocate(const size_t n)
+	{
+		if (1 == n)
+			return static_cast< T* >(Pool< sizeof(T), alignof(T) >::allocate());
+
+		return static_cast< T* >(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T* const p, const size_t n)
+	{
+		if (1 == n)
+			Pool< sizeof(T), alignof(T) >::deallocate(p);
+		else
+			::operator delete(p);
+	}
+};
+
+template < typename T, typename U >
+inline bool operator ==(const PoolAllocator< T >&, const PoolAllocator< U >&)
+{
+	return true;
+}
+
+template < typename T, typename U >
+inline bool operator !=(const PoolAllocator< T >&, const PoolAllocator< U >&)
+{
+	return false;
+}
+
+} // namespace mem
+
+#endif // __mem_h
@@ -0,0 +1,273 @@
+#if !defined(__opt_h)
+#define __opt_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "isa.h"
+#include "bb.h"
+#include "reg.h"
+#include "cfg.h"
+#include "csr.h"
+
+// Optimisation passes over an analysed CFG
+
+namespace opt {
+
+namespace detail {
+
+// no constant -- a register or 'storage' slot holding different values on different paths, an unknown, or nothing at all
+constexpr uint32_t must_none = uint32_t(-1);
+
+// must-constants -- per register and 'storage' slot, the constant it holds on every path reaching a point, or must-none
+template < size_t RegCount >
+struct MustState {
+	uint32_t reg[RegCount];
+	std::vector< uint32_t > stack; // bottom to top
+	bool set = false; // reached
+
+	MustState() { std::fill(reg, reg + RegCount, must_none); }
+};
+
+// update must-constants according to an instruction; mirrors ControlFlowGraph::transfer
+template < size_t RegCount >
+inline void transferMust(const isa::Instr instr, MustState< RegCount >& state)
+{
+	using namespace isa;
+
+	const Opcode op = instr.getOpcode();
+	const Operand dst = instr.getOperand(0);
+
+	switch (op) {
+	case op_li:
+	case op_push:
+	case op_pop:
+	case op_op2:
+	case op_op3:
+		if (dst >= RegCount)
+			return;
+		break;
+	default:
+		return;
+	}
+
+	switch (op) {
+	case op_li:
+		state.reg[dst] = instr.getImm();
+		break;
+	case op_push:
+		state.stack.push_back(state.reg[dst]);
+		state.reg[dst] = must_none;
+		break;
+	case op_pop:
+		state.reg[dst] = state.stack.empty() ? must_none : state.stack.back();
+		if (!state.stack.empty())
+			state.stack.pop_back();
+		break;
+	case op_op2:
+	case op_op3:
+		state.reg[dst] = must_none;
+		break;
+	}
+}
+
+// meet must-constants at a join, keeping only the constants both sides agree on; return false on mismatching 'storage'
+// heights
+template < size_t RegCount >
+inline bool meetMust(MustState< RegCount >& dst, const MustState< RegCount >& src, bool& changed)
+{
+	if (!dst.set) {
+		dst = src;
+		changed = true;
+		return true;
+	}
+
+	if (dst.stack.size() != src.stack.size())
+		return false;
+
+	for (size_t i = 0; i < RegCount; ++i) {
+		if (dst.reg[i] != src.reg[i] && must_none != dst.reg[i]) {
+			dst.reg[i] = must_none;
+			changed = true;
+		}
+	}
+
+	for (size_t i = 0; i < dst.stack.size(); ++i) {
+		if (dst.stack[i] != src.stack[i] && must_none != dst.stack[i]) {
+			dst.stack[i] = must_none;
+			changed = true;
+		}
+	}
+
+	return true;
+}
+
+// compute must-constants at entry of all BBs reachable from the given entry BB, the entry getting no constants from
+// outside; BBs are given by dense ids, their instructions by callable instructions(id) returning an [begin, end) pair of
+// instruction ptrs, and their successors by callable successors(id, ids); return false on mismatching 'storage' heights
+template < size_t RegCount, typename Instructions, typename Successors >
+inline bool solveMust(const size_t blockCount, const size_t entry, Instructions&& instructions, Successors&& successors,
+	std::vector< MustState< RegCount > >& states)
+{
+	states.assign(blockCount, MustState< RegCount >());
+	states[entry].set = true;
+
+	std::vector< size_t > work(1, entry);
+	std::vector< size_t > succ;
+
+	while (!work.empty()) {
+		const size_t id = work.back();
+		work.pop_back();
+
+		MustState< RegCount > curr = states[id];
+		const std::pair< const isa::Instr*, const isa::Instr* > range = instructions(id);
+
+		for (const isa::Instr* it = range.first; it != range.second; ++it)
+			transferMust(*it, curr);
+
+		successors(id, succ);
+		for (const auto it : succ) {
+			bool changed = false;
+			if (!meetMust(states[it], curr, changed))
+				return false;
+
+			if (changed)
+				work.push_back(it);
+		}
+	}
+
+	return true;
+}
+
+// find loads of immediates into registers already holding that immediate on every path, given the must-constants at
+// entry of every BB, as per solveMust; report each load to callable found(id, index) as its BB id and instruction index
+template < size_t RegCount, typename Instructions, typename Found >
+inline void findMustLoads(const std::vector< MustState< RegCount > >& states, Instructions&& instructions, Found&& found)
+{
+	using namespace isa;
+
+	for (size_t id = 0; id < states.size(); ++id) {
+		if (!states[id].set)
+			continue;
+
+		MustState< RegCount > curr = states[id];
+		const std::pair< const Instr*, const Instr* > range = instructions(id);
+
+		for (const Instr* it = range.first; it != range.second; ++it) {
+			const Operand dst = it->getOperand(0);
+
+			if (op_li == it->getOpcode() && dst < RegCount && curr.reg[dst] == it->getImm()) {
+				found(id, size_t(it - range.first));
+				continue;
+			}
+
+			transferMust(*it, curr);
+		}
+	}
+}
+
+} // namespace detail
+
+// replace with nops all loads of immediates into registers already holding that immediate on every path from the given
+// entry, e.g. re-loads of constants restored from 'storage'; constants are tracked on their own, intersected at joins,
+// a register vacated on any path holding none; mandates a CFG solved from the given entry, whose edges the loads are
+// tracked along; BBs not reached from the entry are left intact; return the number of replaced loads
+template < size_t RegCount >
+inline size_t eliminateRedundantLoads(cfg::BasicControlFlowGraph< RegCount >& graph, const bb::Address entry)
+{
+	using namespace bb;
+	using namespace isa;
+
+	// BBs by dense ids, in address order
+	std::vector< BasicBlock* > blocks;
+	for (const auto& it : graph)
+		blocks.push_back(graph.getBasicBlock(it.getStartAddress()));
+
+	const auto findBlock = [&](const Address addr) -> size_t {
+		const std::vector< BasicBlock* >::const_iterator it = std::lower_bound(blocks.begin(), blocks.end(), addr,
+			[](const BasicBlock* const lhs, const Address rhs) { return uint32_t(lhs->getStartAddress()) < uint32_t(rhs); });
+		return it != blocks.end() && uint32_t((*it)->getStartAddress()) == uint32_t(addr) ? size_t(it - blocks.begin()) : blocks.size();
+	};
+
+	const size_t entryId = findBlock(entry);
+	if (entryId == blocks.size() || !graph.isReached(entry))
+		return 0;
+
+	const auto instructions = [&](const size_t id) {
+		const Instructions& seq = blocks[id]->getSequence();
+		return std::make_pair(seq.data(), seq.data() + seq.size());
+	};
+
+	BTB targets;
+	const auto successors = [&](const size_t id, std::vector< size_t >& succ) {
+		succ.clear();
+		graph.getExitTargets(blocks[id]->getStartAddress(), targets);
+
+		for (const auto it : targets) {
+			const size_t target = findBlock(it);
+			if (target != blocks.size())
+				succ.push_back(target);
+		}
+	};
+
+	std::vector< detail::MustState< RegCount > > states;
+	if (!detail::solveMust(blocks.size(), entryId, instructions, successors, states))
+		return 0;
+
+	std::vector< std::pair< size_t, size_t > > loads;
+	detail::findMustLoads(states, instructions, [&](const size_t id, const size_t index) {
+		loads.push_back(std::make_pair(id, index));
+	});
+
+	Instr nop(op_nop);
+	nop.setOperand(0, reg_invalid, true);
+
+	for (const auto& it : loads)
+		blocks[it.first]->replaceInstr(it.second, nop);
+
+	for (size_t i = 0; i < loads.size(); ++i) {
+		if (i + 1 == loads.size() || loads[i + 1].first != loads[i].first) {
+			const bool success = blocks[loads[i].first]->validate();
+			assert(success);
+		}
+	}
+
+	return loads.size();
+}
+
+// find loads eliminateRedundantLoads would replace, in a frozen CFG, tracking constants along its successor arrays; return
+// the number of redundant loads, appending their addresses to the given vector
+template < size_t RegCount >
+inline size_t findRedundantLoads(const csr::BasicFrozenGraph< RegCount >& graph, const bb::Address entry,
+	std::vector< bb::Address >& loads)
+{
+	const csr::BlockId entryId = graph.findBlock(entry);
+	if (csr::block_invalid == entryId || !graph.isReached(entryId))
+		return 0;
+
+	const auto instructions = [&](const size_t id) {
+		return std::make_pair(graph.beginInstr(csr::BlockId(id)), graph.endInstr(csr::BlockId(id)));
+	};
+
+	const auto successors = [&](const size_t id, std::vector< size_t >& succ) {
+		succ.assign(graph.beginSucc(csr::BlockId(id)), graph.endSucc(csr::BlockId(id)));
+	};
+
+	std::vector< detail::MustState< RegCount > > states;
+	if (!detail::solveMust(graph.getBlockCount(), entryId, instructions, successors, states))
+		return 0;
+
+	const size_t count = loads.size();
+	detail::findMustLoads(states, instructions, [&](const size_t id, const size_t index) {
+		loads.push_back(graph.getStartAddress(csr::BlockId(id)) + bb::Address(index));
+	});
+
+	return loads.size() - count;
+}
+
+} // namespace opt
+
+#endif // __opt_h
@@ -4,7 +4,9 @@
 #include <stdint.h>
 #include <assert.h>
 #include <map>
+#include <type_traits>
 #include "isa.h"
+#include "mem.h"
 
 // GPR file occupancy map -- stores constants and unknowns, per register
 
@@ -12,7 +14,8 @@ namespace reg {
 
 typedef isa::Operand Register;
 typedef isa::Word Value;
-typedef std::multimap< Register, Value > Values;
+// registry values are node-allocated from per-thread pools -- see mem::Pool
+typedef std::multimap< Register, Value, std::less< Register >, mem::PoolAllocator< std::pair< const Register, Value > > > Values;
 
 // next type needs to be a derivation and not a mere typedef -- latter breaks ranged-for
 struct ValueRange : std::pair< Values::const_iterator, Values::const_iterator >
@@ -31,14 +34,38 @@ inline Values::const_iterator end(const ValueRange& range)
 	return range.second;
 }
 
-class Registry {
+// largest GPR file -- every register but reg-invalid
+constexpr size_t reg_count_max = size_t(isa::reg_invalid);
+
+// GPR-file widths the analysis is specialised for, besides the largest one
+constexpr size_t reg_count_16 = 16;
+constexpr size_t reg_count_32 = 32;
+constexpr size_t reg_count_64 = 64;
+
+// registry of a GPR file of a compile-time width RegCount; register occupancy is tracked in a fixed-width bit set, held
+// in the narrowest machine word that fits the entire file, or in as few 64-bit words as needed for files wider than that
+template < size_t RegCount >
+class BasicRegistry {
+	static_assert(0 < RegCount && RegCount <= reg_count_max, "unsupported GPR-file width");
+
+	typedef typename std::conditional< (RegCount <= 16), uint16_t,
+		typename std::conditional< (RegCount <= 32), uint32_t, uint64_t >::type >::type Occupancy;
+
+	static constexpr size_t occupancy_bits = sizeof(Occupancy) * 8;
+	static constexpr size_t occupancy_count = (RegCount + occupancy_bits - 1) / occupancy_bits;
+
 	Values values;
+	Occupancy occupancy[occupancy_count] = {}; // one bit per register, set when the register has any values
+
+	static Occupancy occupancyBit(const Register reg) { return Occupancy(1) << reg % occupancy_bits; }
 
 public:
+	static constexpr size_t reg_count = RegCount;
+
 	// add unknown to the given register; at most one unknown tracked per register
 	void addUnknown(const Register);
-	// add new value to the given register
-	void addValue(const Register, const Value);
+	// add new value to the given register; return true if the value was not present already
+	bool addValue(const Register, const Value);
 	// vacate the given register -- remove all records of it
 	void vacate(const Register);
 
@@ -47,8 +74,10 @@ public:
 	// get occupancy of the given register, whether by values or unknowns
 	bool occupied(const Register) const;
 
-	// add the content of another registry to this one
-	void merge(const Registry&);
+	// add the content of another registry to this one; return true if this registry changed
+	bool merge(const BasicRegistry&);
+	// get bytes taken on the heap by the registry, its own body excluded
+	mem::Usage memoryUsage() const;
 
 	// get immutable start iterator of the registry (first element)
 	Values::const_iterator begin() const;
@@ -56,57 +85,140 @@ public:
 	Values::const_iterator end() const;
 };
 
-inline void Registry::addValue(const Register reg, const Value val)
+typedef BasicRegistry< reg_count_max > Registry;
+
+template < size_t RegCount >
+inline bool BasicRegistry< RegCount >::addValue(const Register reg, const Value val)
 {
+	assert(reg < RegCount);
+
 	// check if this reg-val pair is already present
-	const std::pair< Values::const_iterator, Values::const_iterator > range = values.equal_range(reg);
+	const std::pair< Values::const_iterator, Values::const_iterator > range = getValues(reg);
 	for (Values::const_iterator it = range.first; it != range.second; ++it) {
 		if (it->second == val)
-			return;
+			return false;
 	}
 
-	values.insert(Values::value_type(reg, val));
+	values.insert(range.second, Values::value_type(reg, val));
+	occupancy[reg / occupancy_bits] |= occupancyBit(reg);
+	return true;
 }
 
-inline void Registry::addUnknown(const Register reg)
+template < size_t RegCount >
+inline void BasicRegistry< RegCount >::addUnknown(const Register reg)
 {
 	addValue(reg, isa::word_invalid);
 }
 
-inline void Registry::vacate(const Register reg)
+template < size_t RegCount >
+inline void BasicRegistry< RegCount >::vacate(const Register reg)
 {
+	if (!occupied(reg))
+		return;
+
 	// erase any values
 	const std::pair< Values::const_iterator, Values::const_iterator > range = values.equal_range(reg);
 	values.erase(range.first, range.second);
+	occupancy[reg / occupancy_bits] &= ~occupancyBit(reg);
 }
 
-inline ValueRange Registry::getValues(const Register reg) const
+template < size_t RegCount >
+inline ValueRange BasicRegistry< RegCount >::getValues(const Register reg) const
 {
+	if (!occupied(reg)) {
+		const std::pair< Values::const_iterator, Values::const_iterator > range(values.end(), values.end());
+		return range;
+	}
+
 	const std::pair< Values::const_iterator, Values::const_iterator > range = values.equal_range(reg);
 	return range;
 }
 
-inline bool Registry::occupied(const Register reg) const
+template < size_t RegCount >
+inline bool BasicRegistry< RegCount >::occupied(const Register reg) const
 {
-	return values.find(reg) != values.end();
+	assert(reg < RegCount);
+	return 0 != (occupancy[reg / occupancy_bits] & occupancyBit(reg));
 }
 
-inline void Registry::merge(const Registry& oth)
+template < size_t RegCount >
+inline bool BasicRegistry< RegCount >::merge(const BasicRegistry& oth)
 {
-	for (auto it : oth.values)
-		addValue(it.first, it.second);
+	if (values.empty()) {
+		*this = oth;
+		return !values.empty();
+	}
+
+	// registers new to this registry, as per the occupancy words, take the other's values wholesale, inserted in a single
+	// ordered pass; only registers both registries occupy need their values deduplicated
+	Occupancy fresh[occupancy_count];
+	for (size_t i = 0; i < occupancy_count; ++i)
+		fresh[i] = oth.occupancy[i] & ~occupancy[i];
+
+	bool changed = false;
+	Values::const_iterator cursor = values.begin();
+
+	for (const auto& it : oth.values) {
+		const Register reg = it.first;
+
+		if (0 == (fresh[reg / occupancy_bits] & occupancyBit(reg))) {
+			changed |= addValue(reg, it.second);
+			continue;
+		}
+
+		while (cursor != values.end() && cursor->first < reg)
+			++cursor;
+
+		values.insert(cursor, it);
+		occupancy[reg / occupancy_bits] |= occupancyBit(reg);
+		changed = true;
+	}
+
+	return changed;
 }
 
-inline Values::const_iterator Registry::begin() const
+template < size_t RegCount >
+inline mem::Usage BasicRegistry< RegCount >::memoryUsage() const
+{
+	mem::Usage usage;
+	usage.registries = values.size() * sizeof(Values::value_type);
+	usage.overhead = values.size() * mem::tree_node_overhead;
+	return usage;
+}
+
+template < size_t RegCount >
+inline Values::const_iterator BasicRegistry< RegCount >::begin() const
 {
 	return values.begin();
 }
 
-inline Values::const_iterator Registry::end() const
+template < size_t RegCount >
+inline Values::const_iterator BasicRegistry< RegCount >::end() const
 {
 	return values.end();
 }
 
+// pick the narrowest specialised GPR-file width accommodating the given register count, and invoke the given callable
+// with that width as an std::integral_constant, e.g. dispatch(count, [](auto width) { BasicRegistry< width > r; })
+template < typename Func >
+inline auto dispatch(const size_t regCount, Func&& func)
+{
+	if (regCount <= reg_count_16)
+		return func(std::integral_constant< size_t, reg_count_16 >());
+	if (regCount <= reg_count_32)
+		return func(std::integral_constant< size_t, reg_count_32 >());
+	if (regCount <= reg_count_64)
+		return func(std::integral_constant< size_t, reg_count_64 >());
+
+	assert(regCount <= reg_count_max);
+	return func(std::integral_constant< size_t, reg_count_max >());
+}
+
+extern template class BasicRegistry< reg_count_16 >;
+extern template class BasicRegistry< reg_count_32 >;
+extern template class BasicRegistry< reg_count_64 >;
+extern template class BasicRegistry< reg_count_max >;
+
 } // namespace reg
 
 #endif // __reg_h
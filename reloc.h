@@ -0,0 +1,291 @@
+#if !defined(__reloc_h)
+#define __reloc_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "isa.h"
+#include "bb.h"
+#include "cfg.h"
+#include "image.h"
+
+// Relocation -- compaction of a CFG by dropping nops and packing its BBs, and patching of branch-target immediates
+
+namespace reloc {
+
+// old-to-new start addresses of relocated BBs, in ascending order
+typedef std::vector< std::pair< bb::Address, bb::Address > > AddressMap;
+
+// instruction to insert while relocating, before the instruction at the given index of the given BB, or past its last
+// instruction for an index equal to the BB size
+struct Insertion {
+	bb::Address start;
+	size_t index;
+	isa::Instr instr;
+};
+
+// edits to carry out while relocating -- instructions to drop, by address, and instructions to insert, those at the same
+// spot going in the given order; inserted loads are never patched
+struct Edits {
+	std::vector< bb::Address > drops;
+	std::vector< Insertion > inserts;
+};
+
+namespace detail {
+
+// load sites -- addresses of the loads whose immediates a register or 'storage' slot may hold, in ascending order
+typedef std::vector< uint32_t > Sites;
+
+// load sites of a GPR file and 'storage' at some point
+struct SiteState {
+	std::vector< Sites > reg; // per register
+	std::vector< Sites > stack; // bottom to top
+};
+
+// add load sites to others; return true if any got added
+inline bool mergeSites(Sites& dst, const Sites& src)
+{
+	if (std::includes(dst.begin(), dst.end(), src.begin(), src.end()))
+		return false;
+
+	Sites merged;
+	std::set_union(dst.begin(), dst.end(), src.begin(), src.end(), std::back_inserter(merged));
+	dst.swap(merged);
+	return true;
+}
+
+// find the loads whose immediates may reach the branch-target operand of a br or cbr in a solved CFG, following the
+// edges of its solution from all reached BBs; immediates get tracked through spills to 'storage' and lost to any other
+// op; return false on mismatching 'storage' heights
+// A single sweep cannot tell branch-target loads from loads of data that equal BB starts: a load reaches its branch along
+// loops and through 'storage', so this is a fixpoint over per-BB load-site sets; sets only grow, so every BB gets
+// re-evaluated at most once per site added to its entry state -- typically a few times, as a load reaches few branches
+template < size_t RegCount >
+inline bool findTargetLoads(const cfg::BasicControlFlowGraph< RegCount >& graph, std::unordered_set< uint32_t >& loads)
+{
+	using namespace bb;
+	using namespace isa;
+
+	std::unordered_map< uint32_t, SiteState > states;
+	std::vector< Address > work;
+
+	// seed every reached BB with no load sites, at its solved 'storage' height
+	for (const auto& it : graph) {
+		const Address start = it.getStartAddress();
+		if (!graph.isReached(start))
+			continue;
+
+		SiteState& state = states[start];
+		state.reg.resize(RegCount);
+		state.stack.resize(graph.getStack(start)[cfg::order_entry].height());
+		work.push_back(start);
+	}
+
+	BTB targets;
+	while (!work.empty()) {
+		const Address start = work.back();
+		work.pop_back();
+
+		SiteState curr = states[start];
+		Address currAddress = start;
+
+		for (const auto instr : graph.getBasicBlock(start)->getSequence()) {
+			const Opcode op = instr.getOpcode();
+			const Operand dst = instr.getOperand(0);
+			const Address addr = currAddress++;
+
+			if (op_nop == op || dst >= RegCount)
+				continue;
+
+			switch (op) {
+			case op_li:
+				curr.reg[dst].assign(1, addr);
+				break;
+			case op_push:
+				curr.stack.push_back(std::move(curr.reg[dst]));
+				curr.reg[dst].clear();
+				break;
+			case op_pop:
+				curr.reg[dst].clear();
+				if (!curr.stack.empty()) {
+					curr.reg[dst].swap(curr.stack.back());
+					curr.stack.pop_back();
+				}
+				break;
+			case op_br:
+			case op_cbr:
+				loads.insert(curr.reg[dst].begin(), curr.reg[dst].end());
+				break;
+			case op_op2:
+			case op_op3:
+				curr.reg[dst].clear();
+				break;
+			}
+		}
+
+		graph.getExitTargets(start, targets);
+		for (const auto target : targets) {
+			const std::unordered_map< uint32_t, SiteState >::iterator it = states.find(target);
+			if (it == states.end())
+				continue;
+
+			SiteState& state = it->second;
+			if (state.stack.size() != curr.stack.size())
+				return false;
+
+			bool changed = false;
+			for (size_t i = 0; i < RegCount; ++i)
+				changed = mergeSites(state.reg[i], curr.reg[i]) || changed;
+
+			for (size_t i = 0; i < curr.stack.size(); ++i)
+				changed = mergeSites(state.stack[i], curr.stack[i]) || changed;
+
+			if (changed)
+				work.push_back(target);
+		}
+	}
+
+	return true;
+}
+
+} // namespace detail
+
+// relocate a solved CFG into an empty one, carrying out the given edits, if any, dropping all nops and packing all BBs back
+// to back from the lowest BB address on; BBs left empty map to the BB that follows them; immediates of loads that may
+// reach the branch target operand of a br or cbr in the unedited CFG get patched to the new addresses of the BBs they
+// start, in a single pass over the relocated image, while loads of data and of targets outside of the CFG span are left
+// intact; the relocated CFG needs to be solved anew; return false if a patched immediate becomes unrepresentable, or if
+// a branch target within the CFG span is no BB start, and so has no new address
+template < size_t RegCount >
+inline bool relocate(const cfg::BasicControlFlowGraph< RegCount >& src, cfg::BasicControlFlowGraph< RegCount >& dst,
+	image::Image& image, AddressMap& map, const Edits& edits = Edits())
+{
+	using namespace bb;
+	using namespace isa;
+
+	map.clear();
+	image.instr.clear();
+	image.base = src.begin() != src.end() ? src.begin()->getStartAddress() : addr_invalid;
+
+	// find the loads of branch targets, as opposed to loads of data that happen to equal BB starts
+	std::unordered_set< uint32_t > targetLoads;
+	if (!detail::findTargetLoads(src, targetLoads)) {
+		fprintf(stderr, "error: mismatching 'storage' heights in CFG to relocate\n");
+		return false;
+	}
+
+	// lay out the packed BBs; BBs left empty map to the next non-empty BB
+	std::unordered_map< uint32_t, uint32_t > newStart;
+	std::vector< size_t > blockEnd;
+	std::vector< std::pair< size_t, Address > > patches; // relocated index and source address of each load to patch
+	Address cursor = image.base;
+
+	const std::unordered_set< uint32_t > drops(edits.drops.begin(), edits.drops.end());
+	std::vector< const Insertion* > inserts;
+	for (const auto& it : edits.inserts)
+		inserts.push_back(&it);
+
+	std::stable_sort(inserts.begin(), inserts.end(), [](const Insertion* const lhs, const Insertion* const rhs) -> bool {
+		return uint32_t(lhs->start) != uint32_t(rhs->start) ? uint32_t(lhs->start) < uint32_t(rhs->start) : lhs->index < rhs->index;
+	});
+
+	uint32_t spanEnd = image.base; // end of the last BB
+	std::vector< const Insertion* >::const_iterator insert = inserts.begin();
+	const auto emit = [&](const Address start, const size_t index) {
+		for (; insert != inserts.end() && uint32_t((*insert)->start) == uint32_t(start) && (*insert)->index == index; ++insert) {
+			image.instr.push_back((*insert)->instr);
+			++cursor;
+		}
+	};
+
+	for (const auto& it : src) {
+		const Instructions& seq = it.getSequence();
+		map.push_back(AddressMap::value_type(it.getStartAddress(), cursor));
+		Address currAddress = it.getStartAddress();
+
+		// skip insertions into BBs missing from the CFG, or past the ends of BBs
+		while (insert != inserts.end() && (uint32_t((*insert)->start) < uint32_t(currAddress) ||
+			(uint32_t((*insert)->start) == uint32_t(currAddress) && (*insert)->index > seq.size()))) {
+			++insert;
+		}
+
+		for (size_t i = 0; i < seq.size(); ++i) {
+			const Instr instr = seq[i];
+			emit(it.getStartAddress(), i);
+
+			if (op_li == instr.getOpcode() && targetLoads.count(currAddress) && !drops.count(currAddress))
+				patches.push_back(std::make_pair(image.instr.size(), currAddress));
+
+			if (op_nop != instr.getOpcode() && !drops.count(currAddress)) {
+				image.instr.push_back(instr);
+				++cursor;
+			}
+			++currAddress;
+		}
+
+		emit(it.getStartAddress(), seq.size());
+		spanEnd = uint32_t(currAddress);
+
+		newStart[it.getStartAddress()] = map.back().second;
+		blockEnd.push_back(image.instr.size());
+	}
+
+	// patch branch-target immediates
+	const uint32_t spanStart = image.base;
+	for (const auto& it : patches) {
+		Instr& instr = image.instr[it.first];
+
+		const std::unordered_map< uint32_t, uint32_t >::const_iterator jt = newStart.find(instr.getImm());
+		if (jt == newStart.end()) {
+			if (spanStart <= instr.getImm() && instr.getImm() < spanEnd) {
+				fprintf(stderr, "error: branch target %08x of instr at %08x is no BB start\n", instr.getImm(), uint32_t(it.second));
+				return false;
+			}
+			continue;
+		}
+
+		if (!instr.setImm(jt->second)) {
+			fprintf(stderr, "error: relocated target %08x of instr at %08x is not representable as an immediate\n",
+				jt->second, uint32_t(it.second));
+			return false;
+		}
+	}
+
+	// rebuild the BBs at their new addresses
+	size_t first = 0;
+	for (size_t i = 0; i < map.size(); ++i) {
+		if (first == blockEnd[i])
+			continue;
+
+		BasicBlock block(map[i].second);
+		for (; first < blockEnd[i]; ++first)
+			block.addInstr(image.instr[first]);
+
+		if (!block.validate() || !dst.addBasicBlock(std::move(block))) {
+			fprintf(stderr, "error: relocated BB at %08x is invalid\n", uint32_t(map[i].second));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// write out an address map as text, one 'old new' pair per line
+inline bool writeAddressMap(FILE* f, const AddressMap& map)
+{
+	for (const auto& it : map) {
+		if (0 > fprintf(f, "%08x %08x\n", uint32_t(it.first), uint32_t(it.second)))
+			return false;
+	}
+
+	return true;
+}
+
+} // namespace reloc
+
+#endif // __reloc_h
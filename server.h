@@ -0,0 +1,768 @@
+#if !defined(__server_h)
+#define __server_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "isa.h"
+#include "bb.h"
+#include "reg.h"
+#include "cfg.h"
+#include "conv.h"
+#include "image.h"
+
+// Analysis server -- keep analysed program images in memory and answer queries about them over a Unix-domain socket;
+// each image is held as an immutable snapshot, so queries run concurrently, a thread per connection, while edits
+// publish new snapshots, re-solved incrementally where possible; a client speaking the protocol comes along
+
+// Protocol -- every message, either way, is a 32-bit LE payload size followed by that many payload bytes; a request
+// payload starts with the request type, a response payload with the status; all integers are LE; values are raw
+// words, bit 31 set for unknowns:
+//   load      path bytes                          -> image id u32, BB count u32
+//   registry  image id u32, address u32           -> 'storage' height u32, value count u32, { reg u8, value u32 } ...
+//   blocks    image id u32                        -> BB count u32, { start u32, instr count u32, reached u8 } ...
+//   spills    image id u32                        -> count u32, { entry u32, reg u8, push u32, used u8, yield u32 } ...
+//   edit      image id u32, address u32, instr u32 -> BB count u32 (instr as per isa::decodeInstr, valid ones only)
+//   shutdown                                      -> (nothing)
+// an error status carries a message string instead
+
+namespace server {
+
+enum Request : uint8_t {
+	request_load = 1, // load and analyse an image file
+	request_registry, // get the registry before an instruction
+	request_blocks,   // list BBs
+	request_spills,   // list save/restore pairs by yield
+	request_edit,     // replace an instruction and re-analyse
+	request_shutdown  // stop serving
+};
+
+enum Status : uint8_t {
+	status_ok,
+	status_error
+};
+
+constexpr size_t message_size_max = 4096; // largest request payload
+constexpr size_t checkpoint_interval = 16; // instructions between registry checkpoints within BBs
+
+typedef std::vector< uint8_t > Message;
+
+// analysed image; immutable once published
+struct Snapshot {
+	image::Image image;
+	cfg::ControlFlowGraph graph;
+	conv::Functions functions;
+	std::vector< conv::Candidate > candidates;
+};
+
+// complete a snapshot of a solved CFG -- recognise its functions, rank their spills, and compute checkpoints in all reached
+// BBs; return false on failure
+inline bool complete(Snapshot& snapshot)
+{
+	cfg::ControlFlowGraph& graph = snapshot.graph;
+	snapshot.functions.clear();
+	if (!conv::recognise(graph, snapshot.functions))
+		return false;
+
+	conv::rankSpills(snapshot.functions, snapshot.candidates);
+
+	// checkpoints get computed on demand by the mutable getRegistryAt only; compute them all now, so that the const one
+	// answers queries in bounded time; those still valid are kept
+	graph.setCheckpointInterval(checkpoint_interval);
+
+	cfg::ControlFlowGraph::Registry reg;
+	cfg::ControlFlowGraph::Stack stack;
+	for (const auto& it : graph) {
+		if (graph.isReached(it.getStartAddress()))
+			graph.getRegistryAt(it.getStartAddress(), reg, stack);
+	}
+
+	return true;
+}
+
+// analyse an image from its base into a snapshot, with cbr comparing as per the given predicate, if any, and with
+// checkpoints in all reached BBs; return nullptr on failure
+inline std::shared_ptr< const Snapshot > analyse(image::Image&& image, const cfg::Predicate predicate)
+{
+	std::shared_ptr< Snapshot > snapshot = std::make_shared< Snapshot >();
+	snapshot->image = std::move(image);
+
+	cfg::ControlFlowGraph& graph = snapshot->graph;
+	graph.setPredicate(predicate);
+	if (!image::load(snapshot->image, graph) || !graph.solve(snapshot->image.base) || !complete(*snapshot))
+		return nullptr;
+
+	return snapshot;
+}
+
+// analyse a snapshot with the instruction at the given index replaced into a new snapshot; an edit keeping the BB
+// boundaries gets re-solved incrementally -- only the BBs reachable from the edited one in the old solution get reset and
+// re-solved from their predecessors, and all other BBs keep their registries, transfer summaries and checkpoints, as per
+// their revisions (see cfg::Transfer); any other edit gets the image analysed anew; return nullptr on failure
+inline std::shared_ptr< const Snapshot > reanalyse(const Snapshot& snapshot, const size_t index, const isa::Instr instr,
+	const cfg::Predicate predicate)
+{
+	using namespace bb;
+
+	image::Image image = snapshot.image;
+	image.instr[index] = instr;
+
+	std::vector< Address > leaders;
+	std::vector< Address > editedLeaders;
+	image::getLeaders(snapshot.image, leaders);
+	image::getLeaders(image, editedLeaders);
+
+	if (leaders != editedLeaders)
+		return analyse(std::move(image), predicate);
+
+	const Address address = image.base + Address(uint32_t(index));
+	const Address start = *--std::upper_bound(leaders.begin(), leaders.end(), address,
+		[](const Address lhs, const Address rhs) { return uint32_t(lhs) < uint32_t(rhs); });
+
+	// BBs reachable from the edited one in the old solution, the only ones whose at-entry state may change
+	std::set< uint32_t > stale;
+	std::vector< Address > work(1, start);
+	BTB targets;
+
+	stale.insert(start);
+	while (!work.empty()) {
+		const Address curr = work.back();
+		work.pop_back();
+
+		snapshot.graph.getExitTargets(curr, targets);
+		for (const auto it : targets) {
+			if (snapshot.graph.getBasicBlock(it) && stale.insert(it).second)
+				work.push_back(it);
+		}
+	}
+
+	std::shared_ptr< Snapshot > edited = std::make_shared< Snapshot >();
+	edited->image = std::move(image);
+	edited->graph = snapshot.graph;
+
+	cfg::ControlFlowGraph& graph = edited->graph;
+	BasicBlock* const block = graph.getBasicBlock(start);
+	block->replaceInstr(size_t(uint32_t(address) - uint32_t(start)), instr);
+	if (!block->validate())
+		return nullptr;
+
+	for (const auto it : stale)
+		graph.resetRegistry(Address(it));
+
+	// re-enter the stale BBs from the rest, and from the entry if stale itself
+	std::vector< Address > seeds;
+	for (const auto& it : graph) {
+		const Address curr = it.getStartAddress();
+		if (stale.count(curr) || !graph.isReached(curr))
+			continue;
+
+		const cfg::ControlFlowGraph::Registry& reg = graph.getRegistry(curr)[cfg::order_exit];
+		const cfg::ControlFlowGraph::Stack& stack = graph.getStack(curr)[cfg::order_exit];
+		graph.getExitTargets(curr, targets);
+
+		for (const auto target : targets) {
+			bool changed;
+			if (!stale.count(target))
+				continue;
+			if (!graph.mergeRegistry(target, reg, stack, changed))
+				return nullptr;
+			seeds.push_back(target);
+		}
+	}
+
+	if (stale.count(edited->image.base)) {
+		cfg::ControlFlowGraph::Registry reg;
+		for (const auto it : edited->image.args)
+			reg.addUnknown(it);
+
+		if (!graph.setRegistry(edited->image.base, std::move(reg)))
+			return nullptr;
+		seeds.push_back(edited->image.base);
+	}
+
+	for (const auto it : seeds) {
+		if (!graph.solve(it))
+			return nullptr;
+	}
+
+	return complete(*edited) ? edited : nullptr;
+}
+
+inline void putU8(Message& msg, const uint8_t val)
+{
+	msg.push_back(val);
+}
+
+inline void putU32(Message& msg, const uint32_t val)
+{
+	for (size_t i = 0; i < sizeof(val); ++i)
+		msg.push_back(uint8_t(val >> i * 8));
+}
+
+inline bool getU32(const Message& msg, size_t& pos, uint32_t& val)
+{
+	if (pos + sizeof(val) > msg.size())
+		return false;
+
+	val = 0;
+	for (size_t i = 0; i < sizeof(val); ++i)
+		val |= uint32_t(msg[pos++]) << i * 8;
+
+	return true;
+}
+
+// read or write exactly the given number of bytes; return false on error or end of stream
+inline bool readAll(const int fd, void* const buffer, const size_t size)
+{
+	for (size_t done = 0; done < size; ) {
+		const ssize_t res = recv(fd, static_cast< uint8_t* >(buffer) + done, size - done, 0);
+		if (0 > res && EINTR == errno)
+			continue;
+		if (0 >= res)
+			return false;
+		done += size_t(res);
+	}
+
+	return true;
+}
+
+inline bool writeAll(const int fd, const void* const buffer, const size_t size)
+{
+	for (size_t done = 0; done < size; ) {
+		const ssize_t res = send(fd, static_cast< const uint8_t* >(buffer) + done, size - done, MSG_NOSIGNAL);
+		if (0 > res && EINTR == errno)
+			continue;
+		if (0 >= res)
+			return false;
+		done += size_t(res);
+	}
+
+	return true;
+}
+
+inline bool readMessage(const int fd, Message& msg, const size_t sizeMax)
+{
+	uint8_t header[sizeof(uint32_t)];
+	if (!readAll(fd, header, sizeof(header)))
+		return false;
+
+	Message sizeMsg(header, header + sizeof(header));
+	size_t pos = 0;
+	uint32_t size;
+	getU32(sizeMsg, pos, size);
+
+	if (size > sizeMax)
+		return false;
+
+	msg.resize(size);
+	return readAll(fd, msg.data(), msg.size());
+}
+
+inline bool writeMessage(const int fd, const Message& msg)
+{
+	Message header;
+	putU32(header, uint32_t(msg.size()));
+	return writeAll(fd, header.data(), header.size()) && writeAll(fd, msg.data(), msg.size());
+}
+
+class Server {
+	std::mutex mutex; // guards images, connections and finished
+	std::mutex editMutex; // serialises edits, so none gets lost
+	std::vector< std::shared_ptr< const Snapshot > > images; // latest snapshots, by image id
+	std::vector< int > connections; // sockets of live connections
+	std::vector< std::thread::id > finished; // connection threads done serving, yet to be joined
+	std::atomic< bool > stopping; // shutdown requested
+	int listener = -1; // listening socket
+	const cfg::Predicate predicate; // cbr comparison, if any
+
+	// get latest snapshot of an image; nullptr if none
+	std::shared_ptr< const Snapshot > getSnapshot(const uint32_t id);
+	// handle a request; return false on a malformed one
+	bool handle(const Message& request, Message& response);
+	// serve a connection until closed
+	void serveConnection(const int fd);
+	// stop accepting connections, and wake up all pending ones
+	void stop();
+
+public:
+	explicit Server(const cfg::Predicate predicate = nullptr) : stopping(false), predicate(predicate) {}
+
+	// load and analyse an image file, and keep it under the next image id; return false on failure
+	bool load(const char* const path, uint32_t& id, size_t& blockCount);
+
+	// listen at the given socket path and serve connections until a shutdown request; return false on failure to listen
+	bool serve(const char* const path);
+};
+
+inline std::shared_ptr< const Snapshot > Server::getSnapshot(const uint32_t id)
+{
+	const std::lock_guard< std::mutex > lock(mutex);
+	return id < images.size() ? images[id] : nullptr;
+}
+
+inline bool Server::load(const char* const path, uint32_t& id, size_t& blockCount)
+{
+	FILE* const f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "error: cannot open %s\n", path);
+		return false;
+	}
+
+	image::Image image;
+	const bool loaded = image::read(f, image);
+	fclose(f);
+
+	if (!loaded || image.instr.empty()) {
+		fprintf(stderr, "error: malformed image %s\n", path);
+		return false;
+	}
+
+	const std::shared_ptr< const Snapshot > snapshot = analyse(std::move(image), predicate);
+	if (!snapshot) {
+		fprintf(stderr, "error: cannot analyse image %s\n", path);
+		return false;
+	}
+
+	blockCount = size_t(std::distance(snapshot->graph.begin(), snapshot->graph.end()));
+
+	const std::lock_guard< std::mutex > lock(mutex);
+	id = uint32_t(images.size());
+	images.push_back(snapshot);
+	return true;
+}
+
+inline bool Server::handle(const Message& request, Message& response)
+{
+	using namespace bb;
+
+	response.clear();
+
+	const auto fail = [&](const char* const what) -> bool {
+		response.clear();
+		putU8(response, status_error);
+		response.insert(response.end(), what, what + strlen(what));
+		return true;
+	};
+
+	if (request.empty())
+		return false;
+
+	size_t pos = 1;
+	uint32_t id = 0;
+	if (request_load != request[0] && request_shutdown != request[0] && !getU32(request, pos, id))
+		return false;
+
+	switch (request[0]) {
+	case request_load: {
+		const std::string path(request.begin() + 1, request.end());
+		size_t blockCount;
+		if (!load(path.c_str(), id, blockCount))
+			return fail("cannot load image");
+
+		putU8(response, status_ok);
+		putU32(response, id);
+		putU32(response, uint32_t(blockCount));
+		return true;
+	}
+	case request_registry: {
+		uint32_t address;
+		if (!getU32(request, pos, address))
+			return false;
+
+		const std::shared_ptr< const Snapshot > snapshot = getSnapshot(id);
+		if (!snapshot)
+			return fail("unknown image");
+
+		cfg::ControlFlowGraph::Registry reg;
+		cfg::ControlFlowGraph::Stack stack;
+		if (0 != address >> 31 || !snapshot->graph.getRegistryAt(Address(address), reg, stack))
+			return fail("address not reached");
+
+		putU8(response, status_ok);
+		putU32(response, uint32_t(stack.height()));
+		putU32(response, uint32_t(std::distance(reg.begin(), reg.end())));
+		for (const auto it : reg) {
+			putU8(response, it.first);
+			putU32(response, uint32_t(it.second) | uint32_t(it.second.reserved) << 31);
+		}
+		return true;
+	}
+	case request_blocks: {
+		const std::shared_ptr< const Snapshot > snapshot = getSnapshot(id);
+		if (!snapshot)
+			return fail("unknown image");
+
+		const cfg::ControlFlowGraph& graph = snapshot->graph;
+		putU8(response, status_ok);
+		putU32(response, uint32_t(std::distance(graph.begin(), graph.end())));
+		for (const auto& it : graph) {
+			putU32(response, it.getStartAddress());
+			putU32(response, uint32_t(it.getSequence().size()));
+			putU8(response, graph.isReached(it.getStartAddress()));
+		}
+		return true;
+	}
+	case request_spills: {
+		const std::shared_ptr< const Snapshot > snapshot = getSnapshot(id);
+		if (!snapshot)
+			return fail("unknown image");
+
+		putU8(response, status_ok);
+		putU32(response, uint32_t(snapshot->candidates.size()));
+		for (const auto& it : snapshot->candidates) {
+			const conv::Function& fn = snapshot->functions[it.function];
+			const conv::Spill& spill = fn.spills[it.spill];
+			putU32(response, fn.entry);
+			putU8(response, spill.reg);
+			putU32(response, spill.push);
+			putU8(response, spill.used);
+			putU32(response, uint32_t(it.yield));
+		}
+		return true;
+	}
+	case request_edit: {
+		uint32_t address;
+		uint32_t raw;
+		if (!getU32(request, pos, address) || !getU32(request, pos, raw))
+			return false;
+
+		const std::lock_guard< std::mutex > editLock(editMutex);
+		const std::shared_ptr< const Snapshot > snapshot = getSnapshot(id);
+		if (!snapshot)
+			return fail("unknown image");
+
+		const uint32_t base = snapshot->image.base;
+		if (address < base || address - base >= snapshot->image.instr.size())
+			return fail("address outside of image");
+
+		const isa::Instr instr = isa::decodeInstr(raw);
+		if (0 != raw >> 31 || isa::op_invalid == instr.getOpcode())
+			return fail("invalid instruction");
+
+		// re-analyse a copy; queries in flight keep using the old snapshot
+		const std::shared_ptr< const Snapshot > edited = reanalyse(*snapshot, address - base, instr, predicate);
+		if (!edited)
+			return fail("cannot analyse edited image");
+
+		const std::lock_guard< std::mutex > lock(mutex);
+		images[id] = edited;
+		putU8(response, status_ok);
+		putU32(response, uint32_t(std::distance(edited->graph.begin(), edited->graph.end())));
+		return true;
+	}
+	case request_shutdown:
+		putU8(response, status_ok);
+		return true;
+	}
+
+	return false;
+}
+
+inline void Server::serveConnection(const int fd)
+{
+	Message request;
+	Message response;
+
+	while (!stopping && readMessage(fd, request, message_size_max)) {
+		if (!handle(request, response)) {
+			fprintf(stderr, "error: malformed request\n");
+			break;
+		}
+
+		if (!writeMessage(fd, response))
+			break;
+
+		// stop only once the requester has got its response
+		if (request_shutdown == request[0])
+			stop();
+	}
+
+	const std::lock_guard< std::mutex > lock(mutex);
+	connections.erase(std::find(connections.begin(), connections.end(), fd));
+	close(fd);
+	finished.push_back(std::this_thread::get_id());
+}
+
+inline void Server::stop()
+{
+	stopping = true;
+
+	const std::lock_guard< std::mutex > lock(mutex);
+	shutdown(listener, SHUT_RDWR);
+	for (const auto it : connections)
+		shutdown(it, SHUT_RDWR);
+}
+
+inline bool Server::serve(const char* const path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "error: socket path too long: %s\n", path);
+		return false;
+	}
+
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (0 > listener || 0 != bind(listener, reinterpret_cast< const sockaddr* >(&addr), sizeof(addr)) || 0 != listen(listener, 16)) {
+		fprintf(stderr, "error: cannot listen at %s: %s\n", path, strerror(errno));
+		if (0 <= listener)
+			close(listener);
+		return false;
+	}
+
+	// connection threads get joined once done serving, as further connections get accepted, and all of them at the end
+	std::vector< std::thread > pool;
+	std::vector< std::thread::id > done;
+
+	const auto reap = [&]() {
+		{
+			const std::lock_guard< std::mutex > lock(mutex);
+			done.swap(finished);
+		}
+
+		for (const auto id : done) {
+			const std::vector< std::thread >::iterator it = std::find_if(pool.begin(), pool.end(),
+				[id](const std::thread& thread) { return thread.get_id() == id; });
+			it->join();
+			pool.erase(it);
+		}
+
+		done.clear();
+	};
+
+	while (!stopping) {
+		const int fd = accept(listener, nullptr, nullptr);
+		if (0 > fd) {
+			if (EINTR == errno || ECONNABORTED == errno)
+				continue;
+			break;
+		}
+
+		reap();
+
+		const std::lock_guard< std::mutex > lock(mutex);
+		if (stopping) {
+			close(fd);
+			break;
+		}
+
+		connections.push_back(fd);
+		pool.push_back(std::thread(&Server::serveConnection, this, fd));
+	}
+
+	for (auto& it : pool)
+		it.join();
+
+	finished.clear();
+	close(listener);
+	unlink(path);
+	return true;
+}
+
+// BB as listed by a server
+struct Block {
+	uint32_t start;
+	uint32_t instrCount;
+	bool reached;
+};
+
+// register value as reported by a server -- a raw word, bit 31 set for unknowns
+typedef std::pair< reg::Register, uint32_t > RegValue;
+
+// client of a server, one request at a time over a single connection; a request answered with an error status fails,
+// with the message kept
+class Client {
+	int fd = -1; // connected socket
+	std::string error; // message of the last error response
+
+	// send a request and receive its response, status stripped; return false on error
+	bool call(const Message& request, Message& response);
+
+public:
+	Client() = default;
+	Client(const Client&) = delete;
+	~Client() { disconnect(); }
+
+	// connect to a server listening at the given socket path; return false on failure
+	bool connect(const char* const path);
+	// close the connection, if any
+	void disconnect();
+	// get the message of the last error response
+	const std::string& getError() const { return error; }
+
+	// see the protocol above for the requests
+	bool load(const char* const path, uint32_t& id, size_t& blockCount);
+	bool registry(const uint32_t id, const bb::Address address, size_t& height, std::vector< RegValue >& values);
+	bool blocks(const uint32_t id, std::vector< Block >& blocks);
+	bool edit(const uint32_t id, const bb::Address address, const isa::Instr instr, size_t& blockCount);
+	bool editRaw(const uint32_t id, const bb::Address address, const uint32_t raw, size_t& blockCount);
+	bool shutdown();
+};
+
+inline bool Client::connect(const char* const path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return false;
+
+	strcpy(addr.sun_path, path);
+	disconnect();
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (0 > fd || 0 != ::connect(fd, reinterpret_cast< const sockaddr* >(&addr), sizeof(addr))) {
+		disconnect();
+		return false;
+	}
+
+	return true;
+}
+
+inline void Client::disconnect()
+{
+	if (0 <= fd)
+		close(fd);
+	fd = -1;
+}
+
+inline bool Client::call(const Message& request, Message& response)
+{
+	if (!writeMessage(fd, request) || !readMessage(fd, response, UINT32_MAX) || response.empty())
+		return false;
+
+	if (status_ok != response[0]) {
+		error.assign(response.begin() + 1, response.end());
+		return false;
+	}
+
+	response.erase(response.begin());
+	return true;
+}
+
+inline bool Client::load(const char* const path, uint32_t& id, size_t& blockCount)
+{
+	Message request;
+	Message response;
+	putU8(request, request_load);
+	request.insert(request.end(), path, path + strlen(path));
+
+	size_t pos = 0;
+	uint32_t count;
+	if (!call(request, response) || !getU32(response, pos, id) || !getU32(response, pos, count))
+		return false;
+
+	blockCount = count;
+	return true;
+}
+
+inline bool Client::registry(const uint32_t id, const bb::Address address, size_t& height, std::vector< RegValue >& values)
+{
+	Message request;
+	Message response;
+	putU8(request, request_registry);
+	putU32(request, id);
+	putU32(request, address);
+
+	size_t pos = 0;
+	uint32_t storageHeight;
+	uint32_t count;
+	if (!call(request, response) || !getU32(response, pos, storageHeight) || !getU32(response, pos, count))
+		return false;
+
+	height = storageHeight;
+	values.clear();
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t value;
+		if (pos >= response.size())
+			return false;
+
+		const reg::Register r = response[pos++];
+		if (!getU32(response, pos, value))
+			return false;
+
+		values.push_back(RegValue(r, value));
+	}
+
+	return true;
+}
+
+inline bool Client::blocks(const uint32_t id, std::vector< Block >& blocks)
+{
+	Message request;
+	Message response;
+	putU8(request, request_blocks);
+	putU32(request, id);
+
+	size_t pos = 0;
+	uint32_t count;
+	if (!call(request, response) || !getU32(response, pos, count))
+		return false;
+
+	blocks.clear();
+	for (uint32_t i = 0; i < count; ++i) {
+		Block block;
+		if (!getU32(response, pos, block.start) || !getU32(response, pos, block.instrCount) || pos >= response.size())
+			return false;
+
+		block.reached = 0 != response[pos++];
+		blocks.push_back(block);
+	}
+
+	return true;
+}
+
+inline bool Client::edit(const uint32_t id, const bb::Address address, const isa::Instr instr, size_t& blockCount)
+{
+	return editRaw(id, address, isa::encodeInstr(instr), blockCount);
+}
+
+inline bool Client::editRaw(const uint32_t id, const bb::Address address, const uint32_t raw, size_t& blockCount)
+{
+	Message request;
+	Message response;
+	putU8(request, request_edit);
+	putU32(request, id);
+	putU32(request, address);
+	putU32(request, raw);
+
+	size_t pos = 0;
+	uint32_t count;
+	if (!call(request, response) || !getU32(response, pos, count))
+		return false;
+
+	blockCount = count;
+	return true;
+}
+
+inline bool Client::shutdown()
+{
+	Message request;
+	Message response;
+	putU8(request, request_shutdown);
+	return call(request, response);
+}
+
+} // namespace server
+
+#endif // __server_h
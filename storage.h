@@ -0,0 +1,165 @@
+#if !defined(__storage_h)
+#define __storage_h
+
+#include <stddef.h>
+#include <assert.h>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <unordered_set>
+#include "reg.h"
+#include "mem.h"
+
+// Spill-stack state of 'storage' -- a persistent (immutable, structurally shared) LIFO of spilled register values;
+// pushing and popping create new stacks in O(1) without disturbing existing ones, so forking at branches is free
+
+namespace storage {
+
+// values of a single spilled register -- any of these could have been spilled
+typedef std::vector< reg::Value > Values;
+
+class Stack {
+	struct Node {
+		Values values; // values of the spilled register
+		std::shared_ptr< const Node > next; // node underneath this one
+		size_t height; // number of nodes from this one down, inclusive
+
+		Node(Values&& values, const std::shared_ptr< const Node >& next) :
+			values(std::move(values)), next(next), height(next ? next->height + 1 : 1) {}
+	};
+
+	std::shared_ptr< const Node > top; // top of the stack; null for the empty stack
+
+	explicit Stack(std::shared_ptr< const Node >&& top) : top(std::move(top)) {}
+
+public:
+	Stack() = default;
+
+	// get stack with the given values pushed on top of this stack
+	Stack push(Values&&) const;
+	// get stack with the top of this stack popped; mandates a non-empty stack
+	Stack pop() const;
+	// get values at the top of the stack; mandates a non-empty stack
+	const Values& peek() const;
+	// get number of spilled registers on the stack
+	size_t height() const;
+	// check if the stack is empty
+	bool empty() const;
+	// check if both stacks share all their nodes
+	bool same(const Stack&) const;
+
+	// get bytes taken on the heap by the stack nodes, the stack body excluded
+	mem::Usage memoryUsage() const;
+	// add bytes taken on the heap by the stack nodes not seen already, e.g. as nodes of other stacks sharing them
+	void memoryUsage(mem::Usage&, std::unordered_set< const void* >& seen) const;
+
+	// add the content of another stack of the same height to this one, slot by slot; return false on height mismatch;
+	// shared bottom parts of both stacks are not visited, so merging a stack with its own fork costs O(fork depth)
+	bool merge(const Stack&, bool& changed);
+};
+
+inline Stack Stack::push(Values&& values) const
+{
+	return Stack(std::allocate_shared< const Node >(mem::PoolAllocator< Node >(), std::move(values), top));
+}
+
+inline Stack Stack::pop() const
+{
+	assert(top);
+	return Stack(std::shared_ptr< const Node >(top->next));
+}
+
+inline const Values& Stack::peek() const
+{
+	assert(top);
+	return top->values;
+}
+
+inline size_t Stack::height() const
+{
+	return top ? top->height : 0;
+}
+
+inline bool Stack::empty() const
+{
+	return !top;
+}
+
+inline bool Stack::same(const Stack& oth) const
+{
+	return top == oth.top;
+}
+
+inline mem::Usage Stack::memoryUsage() const
+{
+	mem::Usage usage;
+	std::unordered_set< const void* > seen;
+	memoryUsage(usage, seen);
+	return usage;
+}
+
+inline void Stack::memoryUsage(mem::Usage& usage, std::unordered_set< const void* >& seen) const
+{
+	for (const Node* node = top.get(); node && seen.insert(node).second; node = node->next.get()) {
+		mem::addVector(node->values, usage.storage, usage);
+		usage.overhead += sizeof(Node) + mem::shared_overhead;
+	}
+}
+
+inline bool Stack::merge(const Stack& oth, bool& changed)
+{
+	changed = false;
+
+	if (height() != oth.height())
+		return false;
+
+	// collect the differing top parts of both stacks, down to their shared bottom
+	std::vector< const Node* > lhs;
+	std::vector< const Node* > rhs;
+	const Node* l = top.get();
+	const Node* r = oth.top.get();
+
+	for (; l != r; l = l->next.get(), r = r->next.get()) {
+		lhs.push_back(l);
+		rhs.push_back(r);
+	}
+
+	// merge slot by slot; nodes are immutable, so a slot that grows requires new nodes for it and everything above it
+	std::vector< Values > merged(lhs.size());
+	size_t lowestChange = lhs.size();
+
+	for (size_t i = 0; i < lhs.size(); ++i) {
+		merged[i] = lhs[i]->values;
+
+		for (const auto val : rhs[i]->values) {
+			bool present = false;
+			for (const auto cur : merged[i]) {
+				if (cur == val && cur.reserved == val.reserved) {
+					present = true;
+					break;
+				}
+			}
+
+			if (!present) {
+				merged[i].push_back(val);
+				lowestChange = i;
+			}
+		}
+	}
+
+	if (lowestChange == lhs.size())
+		return true;
+
+	// rebuild from the lowest changed slot upwards, on top of the unchanged part of this stack
+	std::shared_ptr< const Node > base = lhs[lowestChange]->next;
+	for (size_t i = lowestChange + 1; i-- > 0; )
+		base = std::allocate_shared< const Node >(mem::PoolAllocator< Node >(), std::move(merged[i]), base);
+
+	top = std::move(base);
+	changed = true;
+	return true;
+}
+
+} // namespace storage
+
+#endif // __storage_h
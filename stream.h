@@ -0,0 +1,439 @@
+#if !defined(__stream_h)
+#define __stream_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <utility>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include "isa.h"
+#include "bb.h"
+#include "reg.h"
+#include "storage.h"
+#include "cfg.h"
+#include "image.h"
+#include "mem.h"
+
+// Streaming analysis -- analyse a program image one region (e.g. function) at a time, in topological order, keeping
+// resident only the region at hand, the at-entry states of region entries, and per-region summaries; the image stays
+// resident in its compact form only, and each region gets decoded into BBs when due and evicted once done
+
+namespace stream {
+
+// region of the program -- a range of consecutive BBs, as indices into the BB leaders of an image
+struct Region {
+	size_t first; // index of the first BB
+	size_t last; // index past the last BB
+	size_t rank; // position in topological order
+};
+
+typedef std::vector< Region > Regions;
+
+// split an image into regions, given the leaders of its BBs; a region starts at the image base and at every BB that is a
+// potential branch target, i.e. loaded as an immediate, and that the preceding BB does not fall through to; regions are
+// ranked in reverse post-order of the region graph from the region of the image base, a region leading to another if it
+// loads a BB start of the latter as an immediate; regions unreachable that way rank last, in address order
+inline void getRegions(const image::Image& image, const std::vector< bb::Address >& leaders, Regions& regions)
+{
+	using namespace bb;
+	using namespace isa;
+
+	regions.clear();
+	if (leaders.empty())
+		return;
+
+	const uint32_t base = image.base;
+	const uint32_t end = base + uint32_t(image.instr.size());
+
+	// BB index of an address, or leaders.size() if none starts there
+	const auto findLeader = [&](const uint32_t addr) -> size_t {
+		const std::vector< Address >::const_iterator it = std::lower_bound(leaders.begin(), leaders.end(), addr,
+			[](const Address lhs, const uint32_t rhs) { return uint32_t(lhs) < rhs; });
+		return it != leaders.end() && uint32_t(*it) == addr ? size_t(it - leaders.begin()) : leaders.size();
+	};
+
+	std::vector< uint8_t > target(leaders.size(), 0);
+	for (const auto it : image.instr) {
+		if (op_li == it.getOpcode() && base <= it.getImm() && it.getImm() < end) {
+			const size_t index = findLeader(it.getImm());
+			if (index < leaders.size())
+				target[index] = 1;
+		}
+	}
+
+	std::vector< size_t > regionOf(leaders.size());
+	for (size_t i = 0; i < leaders.size(); ++i) {
+		if (0 == i || (target[i] && op_br == image.instr[leaders[i] - base - 1].getOpcode())) {
+			if (!regions.empty())
+				regions.back().last = i;
+			regions.push_back(Region{ i, leaders.size(), 0 });
+		}
+		regionOf[i] = regions.size() - 1;
+	}
+
+	// region graph, by loads of BB starts
+	std::vector< std::vector< size_t > > succ(regions.size());
+	for (size_t r = 0; r < regions.size(); ++r) {
+		const size_t lo = leaders[regions[r].first] - base;
+		const size_t hi = regions[r].last < leaders.size() ? leaders[regions[r].last] - base : image.instr.size();
+
+		for (size_t i = lo; i < hi; ++i) {
+			const Instr instr = image.instr[i];
+			if (op_li != instr.getOpcode() || instr.getImm() < base || end <= instr.getImm())
+				continue;
+
+			const size_t index = findLeader(instr.getImm());
+			if (index < leaders.size() && regionOf[index] != r)
+				succ[r].push_back(regionOf[index]);
+		}
+
+		std::sort(succ[r].begin(), succ[r].end());
+		succ[r].erase(std::unique(succ[r].begin(), succ[r].end()), succ[r].end());
+	}
+
+	// reverse post-order, via an iterative DFS
+	std::vector< size_t > order;
+	std::vector< uint8_t > visited(regions.size(), 0);
+	std::vector< std::pair< size_t, size_t > > stack(1, std::make_pair(size_t(0), size_t(0)));
+	visited[0] = 1;
+
+	while (!stack.empty()) {
+		const size_t node = stack.back().first;
+		const size_t edge = stack.back().second++;
+
+		if (edge == succ[node].size()) {
+			order.push_back(node);
+			stack.pop_back();
+		}
+		else if (!visited[succ[node][edge]]) {
+			visited[succ[node][edge]] = 1;
+			stack.push_back(std::make_pair(succ[node][edge], size_t(0)));
+		}
+	}
+
+	std::reverse(order.begin(), order.end());
+	for (size_t i = 0; i < regions.size(); ++i) {
+		if (!visited[i])
+			order.push_back(i);
+	}
+
+	for (size_t i = 0; i < order.size(); ++i)
+		regions[order[i]].rank = i;
+}
+
+// streaming analyser of a GPR file of a compile-time width RegCount
+template < size_t RegCount >
+class BasicAnalyser {
+public:
+	typedef cfg::BasicControlFlowGraph< RegCount > ControlFlowGraph;
+	typedef typename ControlFlowGraph::Registry Registry;
+
+	// region summary -- what remains of a region once its BBs are evicted
+	struct Summary {
+		bb::Address entry;      // lowest BB start address in the region
+		size_t blockCount;      // number of BBs in the region
+		size_t instrCount;      // number of instructions in the region
+		size_t passes;          // number of times the region got analysed; zero if never reached
+		Registry exit;          // merged registry at all exits out of the region, including exits to unknown targets
+	};
+
+	// per region, its summary
+	typedef std::vector< Summary > Summaries;
+
+	// at-entry state of a BB reached from outside of its region
+	struct PendingState {
+		Registry reg;
+		storage::Stack stack;
+		bool set = false;
+	};
+
+	// at-entry states of BBs reached from outside of their regions, keyed by BB start address
+	typedef std::map< bb::Address, PendingState > Pending;
+
+private:
+	const image::Image& image; // program image, in its compact form
+	std::vector< bb::Address > leaders; // BB start addresses, ascending
+	std::vector< uint32_t > regionOf; // per BB, index of its region
+	Regions regions; // regions of the image, in address order
+	ControlFlowGraph graph; // BBs of the region currently under analysis
+	Pending pending; // at-entry states of region entries, kept for merging in later arrivals, e.g. via back-edges
+	Summaries summaries; // per region, summary of its latest analysis
+	std::set< std::pair< size_t, size_t > > queue; // regions with changed at-entry states, as (rank, region index)
+	FILE* spill; // optional file where registries of evicted BBs get spilled to
+	size_t peakResident; // peak number of simultaneously-resident BBs
+	mem::Usage peakUsage; // peak memory usage of the resident region
+
+	bool spillBlock(const bb::Address);
+	bool addPending(const bb::Address, const Registry&, const storage::Stack&);
+	bool analyseRegion(const size_t);
+
+public:
+	// set up the analysis of an image, splitting it into regions; the image must outlive the analyser
+	explicit BasicAnalyser(const image::Image&, FILE* spill = nullptr);
+
+	// set registry at entry to the program
+	bool setEntry(const bb::Address, Registry&&);
+	// analyse all regions reachable from the program entry, each in turn as per its rank, and any region anew whenever an
+	// at-entry state of it changes, e.g. via a back-edge from a region analysed later, until no state changes; regions get
+	// evicted upon analysis
+	bool analyse();
+
+	// get regions of the image, in address order
+	const Regions& getRegions() const { return regions; }
+	// get summaries of all regions, in address order
+	const Summaries& getSummaries() const { return summaries; }
+	// get at-entry states of BBs reached from outside of their regions
+	const Pending& getPending() const { return pending; }
+	// get peak number of simultaneously-resident BBs
+	size_t getPeakResident() const { return peakResident; }
+	// get peak memory usage of the resident region, by total
+	const mem::Usage& getPeakMemoryUsage() const { return peakUsage; }
+};
+
+// streaming analyser of the largest GPR file
+typedef BasicAnalyser< reg::reg_count_max > Analyser;
+
+template < size_t RegCount >
+inline BasicAnalyser< RegCount >::BasicAnalyser(const image::Image& image, FILE* spill) : image(image), spill(spill), peakResident(0)
+{
+	image::getLeaders(image, leaders);
+	stream::getRegions(image, leaders, regions);
+
+	regionOf.resize(leaders.size());
+	for (size_t r = 0; r < regions.size(); ++r)
+		std::fill(regionOf.begin() + regions[r].first, regionOf.begin() + regions[r].last, uint32_t(r));
+
+	summaries.resize(regions.size(), Summary{ bb::addr_invalid, 0, 0, 0, Registry() });
+}
+
+template < size_t RegCount >
+inline bool BasicAnalyser< RegCount >::setEntry(const bb::Address start, Registry&& src)
+{
+	const std::vector< bb::Address >::const_iterator it = std::lower_bound(leaders.begin(), leaders.end(), start,
+		[](const bb::Address lhs, const bb::Address rhs) { return uint32_t(lhs) < uint32_t(rhs); });
+
+	if (it == leaders.end() || uint32_t(*it) != uint32_t(start))
+		return false;
+
+	PendingState& state = pending[start];
+	state.reg = std::move(src);
+	state.stack = storage::Stack();
+	state.set = true;
+
+	const size_t r = regionOf[it - leaders.begin()];
+	queue.insert(std::make_pair(regions[r].rank, r));
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicAnalyser< RegCount >::addPending(const bb::Address start, const Registry& src, const storage::Stack& stack)
+{
+	const std::vector< bb::Address >::const_iterator it = std::lower_bound(leaders.begin(), leaders.end(), start,
+		[](const bb::Address lhs, const bb::Address rhs) { return uint32_t(lhs) < uint32_t(rhs); });
+
+	// targets outside of the image, or into the middle of BBs, exit the program
+	if (it == leaders.end() || uint32_t(*it) != uint32_t(start))
+		return true;
+
+	PendingState& state = pending[start];
+	bool changed = !state.set;
+
+	if (!state.set) {
+		state.reg = src;
+		state.stack = stack;
+		state.set = true;
+	}
+	else if (!state.stack.merge(stack, changed)) {
+		fprintf(stderr, "error: BB at %08x reached with mismatching storage heights %lu and %lu\n",
+			uint32_t(start), state.stack.height(), stack.height());
+		return false;
+	}
+	else
+		changed |= state.reg.merge(src);
+
+	if (changed) {
+		const size_t r = regionOf[it - leaders.begin()];
+		queue.insert(std::make_pair(regions[r].rank, r));
+	}
+
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicAnalyser< RegCount >::analyse()
+{
+	while (!queue.empty()) {
+		const size_t r = queue.begin()->second;
+		queue.erase(queue.begin());
+
+		if (!analyseRegion(r))
+			return false;
+	}
+
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicAnalyser< RegCount >::analyseRegion(const size_t index)
+{
+	using namespace bb;
+
+	const Region& region = regions[index];
+	const size_t passes = summaries[index].passes;
+	Summary summary = { .entry = leaders[region.first], .blockCount = 0, .instrCount = 0, .passes = passes + 1, .exit = Registry() };
+	std::vector< Address > entries;
+
+	// decode the region
+	for (size_t i = region.first; i < region.last; ++i) {
+		const size_t first = leaders[i] - image.base;
+		const size_t last = i + 1 < leaders.size() ? leaders[i + 1] - image.base : image.instr.size();
+
+		BasicBlock block(leaders[i]);
+		for (size_t j = first; j < last; ++j)
+			block.addInstr(image.instr[j]);
+
+		if (!block.validate() || !graph.appendBasicBlock(std::move(block))) {
+			fprintf(stderr, "error: invalid BB at %08x\n", uint32_t(leaders[i]));
+			return false;
+		}
+
+		summary.blockCount += 1;
+		summary.instrCount += last - first;
+	}
+
+	// seed the region with the at-entry states of its entries; the states are kept for merging in later arrivals
+	const Address regionEnd = region.last < leaders.size() ? leaders[region.last] : Address(image.base + Address(image.instr.size()));
+	const typename Pending::const_iterator itend = pending.lower_bound(regionEnd);
+
+	for (typename Pending::const_iterator it = pending.lower_bound(summary.entry); it != itend; ++it) {
+		Registry reg = it->second.reg;
+		graph.setRegistry(it->first, std::move(reg), it->second.stack);
+		entries.push_back(it->first);
+	}
+
+	if (peakResident < summary.blockCount)
+		peakResident = summary.blockCount;
+
+	// propagate registries across the region until no BB entry changes; exits out of the region merge into the at-entry
+	// states of their targets, which get their regions queued for analysis on change
+	const auto outside = [&](const Address target, const Address source) -> bool {
+		const Registry& exit = graph.getRegistry(source)[cfg::order_exit];
+		summary.exit.merge(exit);
+
+		// unknown targets cannot become pending
+		return !isAddrValid(target) || addPending(target, exit, graph.getStack(source)[cfg::order_exit]);
+	};
+
+	for (const auto start : entries) {
+		if (!graph.solve(start, outside))
+			return false;
+	}
+
+	const mem::Usage usage = graph.memoryUsage();
+	if (usage.total() > peakUsage.total())
+		peakUsage = usage;
+
+	// evict the region
+	while (graph.begin() != graph.end()) {
+		const Address start = graph.begin()->getStartAddress();
+
+		if (spill && graph.isReached(start) && !spillBlock(start))
+			return false;
+
+		graph.removeBasicBlock(start);
+	}
+
+	summaries[index] = std::move(summary);
+	return true;
+}
+
+// spilled-registry record: 32-bit LE count of reg-val pairs, followed by that many 8-bit register and 32-bit LE value pairs;
+// spilled BB: 32-bit LE start address, followed by one spilled-registry record per RegOrder; only reached BBs get spilled,
+// once per analysis of their region, so later records of a BB supersede earlier ones
+template < size_t RegCount >
+inline bool writeRegistry(FILE* f, const reg::BasicRegistry< RegCount >& registry)
+{
+	uint32_t count = 0;
+	for (auto it = registry.begin(); it != registry.end(); ++it)
+		++count;
+
+	if (1 != fwrite(&count, sizeof(count), 1, f))
+		return false;
+
+	for (const auto it : registry) {
+		// keep the non-architectural bit of values, so unknowns survive the round trip
+		const uint32_t val = it.second.word | uint32_t(it.second.reserved) << 31;
+		if (1 != fwrite(&it.first, sizeof(it.first), 1, f) ||
+			1 != fwrite(&val, sizeof(val), 1, f))
+			return false;
+	}
+
+	return true;
+}
+
+template < size_t RegCount >
+inline bool readRegistry(FILE* f, reg::BasicRegistry< RegCount >& registry)
+{
+	uint32_t count;
+	if (1 != fread(&count, sizeof(count), 1, f))
+		return false;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		reg::Register reg;
+		uint32_t val;
+		if (1 != fread(&reg, sizeof(reg), 1, f) ||
+			1 != fread(&val, sizeof(val), 1, f))
+			return false;
+
+		if (reg >= RegCount)
+			return false;
+
+		registry.addValue(reg, reg::Value(val & ~(1U << 31), val >> 31));
+	}
+
+	return true;
+}
+
+template < size_t RegCount >
+inline bool BasicAnalyser< RegCount >::spillBlock(const bb::Address start)
+{
+	const uint32_t addr = start;
+	const Registry* const reg = graph.getRegistry(start);
+	assert(reg);
+
+	if (1 != fwrite(&addr, sizeof(addr), 1, spill))
+		return false;
+
+	for (size_t i = 0; i < cfg::order__count; ++i) {
+		if (!writeRegistry(spill, reg[i]))
+			return false;
+	}
+
+	return true;
+}
+
+// read back the next BB spilled by an Analyser; returned registries are an array, use RegOrder to index
+template < size_t RegCount >
+inline bool readSpilledBlock(FILE* f, bb::Address& start, reg::BasicRegistry< RegCount > (&reg)[cfg::order__count])
+{
+	uint32_t addr;
+	if (1 != fread(&addr, sizeof(addr), 1, f))
+		return false;
+
+	start = bb::Address(addr);
+
+	for (size_t i = 0; i < cfg::order__count; ++i) {
+		reg[i] = reg::BasicRegistry< RegCount >();
+		if (!readRegistry(f, reg[i]))
+			return false;
+	}
+
+	return true;
+}
+
+} // namespace stream
+
+#endif // __stream_h
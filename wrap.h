@@ -0,0 +1,370 @@
+#if !defined(__wrap_h)
+#define __wrap_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+#include "isa.h"
+#include "bb.h"
+#include "reg.h"
+#include "cfg.h"
+#include "conv.h"
+#include "reloc.h"
+#include "image.h"
+
+// Shrink-wrapping -- move save/restore pairs out of function prologues and epilogues into the region of the function that
+// actually reuses the saved register, so paths around that region run spill-free; pairs nothing reuses get removed
+
+namespace wrap {
+
+struct Result {
+	size_t removed = 0; // pairs removed outright
+	size_t moved = 0; // pairs moved into a region of their function
+};
+
+namespace detail {
+
+constexpr size_t node_invalid = size_t(-1);
+
+// dominator tree of a graph given by successor lists, computed as per Cooper, Harvey and Kennedy; nodes unreachable from
+// the root have no immediate dominator
+struct DomTree {
+	std::vector< size_t > idom; // per node, immediate dominator; the root is its own; node-invalid if unreachable
+	std::vector< size_t > depth; // per node, depth in the tree
+
+	void build(const std::vector< std::vector< size_t > >& succ, const size_t root);
+
+	// get the nearest node dominating both given nodes; mandates reachable nodes
+	size_t common(size_t a, size_t b) const
+	{
+		while (depth[a] > depth[b])
+			a = idom[a];
+		while (depth[b] > depth[a])
+			b = idom[b];
+		while (a != b) {
+			a = idom[a];
+			b = idom[b];
+		}
+		return a;
+	}
+
+	// check if the first node dominates the second; mandates reachable nodes
+	bool dominates(const size_t a, const size_t b) const { return common(a, b) == a; }
+};
+
+inline void DomTree::build(const std::vector< std::vector< size_t > >& succ, const size_t root)
+{
+	const size_t count = succ.size();
+
+	// reverse post-order, via an iterative DFS
+	std::vector< size_t > order;
+	std::vector< size_t > orderIndex(count, node_invalid);
+	std::vector< std::pair< size_t, size_t > > stack(1, std::make_pair(root, size_t(0)));
+	std::vector< uint8_t > visited(count, 0);
+	visited[root] = 1;
+
+	while (!stack.empty()) {
+		const size_t node = stack.back().first;
+		const size_t edge = stack.back().second++;
+
+		if (edge == succ[node].size()) {
+			order.push_back(node);
+			stack.pop_back();
+		}
+		else if (!visited[succ[node][edge]]) {
+			visited[succ[node][edge]] = 1;
+			stack.push_back(std::make_pair(succ[node][edge], size_t(0)));
+		}
+	}
+
+	std::reverse(order.begin(), order.end());
+	for (size_t i = 0; i < order.size(); ++i)
+		orderIndex[order[i]] = i;
+
+	std::vector< std::vector< size_t > > pred(count);
+	for (size_t i = 0; i < count; ++i) {
+		for (const auto it : succ[i])
+			pred[it].push_back(i);
+	}
+
+	idom.assign(count, node_invalid);
+	idom[root] = root;
+
+	const auto intersect = [&](size_t a, size_t b) -> size_t {
+		while (a != b) {
+			while (orderIndex[a] > orderIndex[b])
+				a = idom[a];
+			while (orderIndex[b] > orderIndex[a])
+				b = idom[b];
+		}
+		return a;
+	};
+
+	for (bool changed = true; changed; ) {
+		changed = false;
+
+		for (size_t i = 1; i < order.size(); ++i) {
+			size_t next = node_invalid;
+			for (const auto it : pred[order[i]]) {
+				if (node_invalid != idom[it])
+					next = node_invalid == next ? it : intersect(it, next);
+			}
+
+			if (idom[order[i]] != next) {
+				idom[order[i]] = next;
+				changed = true;
+			}
+		}
+	}
+
+	depth.assign(count, 0);
+	for (size_t i = 1; i < order.size(); ++i)
+		depth[order[i]] = depth[idom[order[i]]] + 1;
+}
+
+// check if a node lies on a cycle
+inline bool isOnCycle(const std::vector< std::vector< size_t > >& succ, const size_t node)
+{
+	std::vector< uint8_t > visited(succ.size(), 0);
+	std::vector< size_t > work(succ[node]);
+
+	while (!work.empty()) {
+		const size_t curr = work.back();
+		work.pop_back();
+
+		if (curr == node)
+			return true;
+
+		if (!visited[curr]) {
+			visited[curr] = 1;
+			work.insert(work.end(), succ[curr].begin(), succ[curr].end());
+		}
+	}
+
+	return false;
+}
+
+// check if an instruction references a register
+inline bool references(const isa::Instr instr, const reg::Register reg)
+{
+	using namespace isa;
+
+	const Opcode op = instr.getOpcode();
+	const size_t noperand = op_nop == op ? 0 : op_li == op ? 1 : 3;
+
+	for (size_t i = 0; i < noperand; ++i) {
+		if (reg == instr.getOperand(i))
+			return true;
+	}
+
+	return false;
+}
+
+} // namespace detail
+
+// shrink-wrap the save/restore pairs of the functions recognised in a solved CFG, innermost pairs first; a pair whose
+// register nothing reuses gets removed; any other pair gets moved into the nearest region, single-entry single-exit and
+// off any cycle, spanning all reuses of its register in the function and its callees, provided that keeps pairs nested;
+// the edits get planned against the given CFG, left intact, and carried out while relocating it into an empty one (see
+// reloc::relocate), which then gets solved from the relocated entry, seeded with the registry and 'storage' of the
+// original entry; return false if relocation or solving fails
+template < size_t RegCount >
+inline bool shrinkWrap(const cfg::BasicControlFlowGraph< RegCount >& graph, const conv::Functions& functions,
+	const bb::Address entry, cfg::BasicControlFlowGraph< RegCount >& dst, image::Image& image, reloc::AddressMap& map,
+	Result& result)
+{
+	using namespace bb;
+	using namespace isa;
+	using detail::node_invalid;
+
+	typedef cfg::BasicControlFlowGraph< RegCount > ControlFlowGraph;
+	typedef typename ControlFlowGraph::Registry Registry;
+	typedef typename ControlFlowGraph::Stack Stack;
+
+	result = Result();
+
+	// callees by call site
+	std::map< Address, std::vector< size_t > > callees;
+	for (size_t i = 0; i < functions.size(); ++i) {
+		for (const auto it : functions[i].callSites)
+			callees[it].push_back(i);
+	}
+
+	// plan all edits against the unedited CFG; pops go in planning order, inner pairs first, pushes in reverse
+	reloc::Edits edits;
+	std::vector< reloc::Insertion > pushes;
+	std::vector< reloc::Insertion > pops;
+
+	for (const auto& fn : functions) {
+		if (fn.spills.empty())
+			continue;
+
+		// nodes are BBs of the body, plus a virtual exit past all returns
+		const size_t count = fn.body.size();
+		const size_t exit = count;
+		std::map< Address, size_t > node;
+		for (size_t i = 0; i < count; ++i)
+			node.insert(std::make_pair(fn.body[i], i));
+
+		std::vector< std::vector< size_t > > succ(count);
+		std::vector< std::vector< size_t > > pred(count + 1);
+		for (const auto& it : fn.edges) {
+			succ[node.at(it.first)].push_back(node.at(it.second));
+			pred[node.at(it.second)].push_back(node.at(it.first));
+		}
+		for (const auto it : fn.returns)
+			pred[exit].push_back(node.at(it));
+
+		detail::DomTree dom;
+		detail::DomTree postDom;
+		dom.build(succ, node.at(fn.entry));
+		postDom.build(pred, exit);
+
+		std::vector< std::pair< size_t, size_t > > regions; // moved regions, as (dominating node, post-dominating node)
+		bool pinned = false; // an inner pair stayed in the prologue, so outer pairs cannot move inside it
+
+		for (size_t i = fn.spills.size(); i-- > 0; ) {
+			const conv::Spill& spill = fn.spills[i];
+			const reg::Register r = spill.reg;
+
+			if (!spill.used) {
+				edits.drops.push_back(spill.push);
+				edits.drops.insert(edits.drops.end(), spill.pops.begin(), spill.pops.end());
+				++result.removed;
+				continue;
+			}
+
+			if (pinned)
+				continue;
+
+			// reuses of the register -- instructions referencing it, besides the pair itself, and calls to functions
+			// clobbering it, which reach over to the return addresses of the calls
+			std::vector< size_t > uses;
+			for (size_t j = 0; j < count; ++j) {
+				const Instructions& seq = graph.getBasicBlock(fn.body[j])->getSequence();
+
+				for (size_t k = 0; k < seq.size(); ++k) {
+					const Address addr = fn.body[j] + Address(k);
+					const bool own = uint32_t(addr) == uint32_t(spill.push) || spill.pops.end() !=
+						std::find_if(spill.pops.begin(), spill.pops.end(), [&](const Address pop) { return uint32_t(pop) == uint32_t(addr); });
+
+					if (!own && detail::references(seq[k], r)) {
+						uses.push_back(j);
+						break;
+					}
+				}
+
+				const std::map< Address, std::vector< size_t > >::const_iterator call = callees.find(fn.body[j]);
+				if (call == callees.end())
+					continue;
+
+				for (const auto it : call->second) {
+					const std::vector< reg::Register >& clobbered = functions[it].clobbered;
+					if (clobbered.end() == std::find(clobbered.begin(), clobbered.end(), r))
+						continue;
+
+					uses.push_back(j);
+					uses.insert(uses.end(), succ[j].begin(), succ[j].end());
+				}
+			}
+
+			// the nearest region spanning all reuses
+			size_t head = node_invalid;
+			size_t tail = node_invalid;
+			bool valid = !uses.empty();
+
+			for (const auto it : uses)
+				valid = valid && node_invalid != dom.idom[it] && node_invalid != postDom.idom[it];
+
+			for (bool changed = valid; changed; ) {
+				size_t nextHead = node_invalid == head ? uses[0] : head;
+				for (const auto it : uses)
+					nextHead = dom.common(nextHead, it);
+				if (node_invalid != tail)
+					nextHead = dom.common(nextHead, tail);
+
+				size_t nextTail = node_invalid == tail ? nextHead : tail;
+				nextTail = postDom.common(nextTail, nextHead);
+				for (const auto it : uses)
+					nextTail = postDom.common(nextTail, it);
+
+				changed = nextHead != head || nextTail != tail;
+				head = nextHead;
+				tail = nextTail;
+				valid = exit != tail && node_invalid != dom.idom[tail];
+				if (!valid)
+					break;
+			}
+
+			// the region must leave the entry spill-free, be entered and left once per pass, and nest with moved pairs
+			valid = valid && node.at(fn.entry) != head && dom.dominates(head, tail) && postDom.dominates(tail, head) &&
+				!detail::isOnCycle(succ, head) && !detail::isOnCycle(succ, tail);
+
+			for (const auto& it : regions)
+				valid = valid && dom.dominates(head, it.first) && postDom.dominates(tail, it.second);
+
+			// the restore goes before the final branch of the tail, which must neither need the register nor return, at the
+			// 'storage' height the region got entered with
+			const Address tailStart = valid ? fn.body[tail] : addr_invalid;
+			size_t tailIndex = 0;
+			if (valid) {
+				const Instructions& seq = graph.getBasicBlock(tailStart)->getSequence();
+				const Instr last = seq.back();
+				Registry reg;
+				Stack stack;
+
+				tailIndex = isBranch(last.getOpcode()) ? seq.size() - 1 : seq.size();
+				valid = fn.returns.end() == std::find(fn.returns.begin(), fn.returns.end(), tailStart) &&
+					!(isBranch(last.getOpcode()) && detail::references(last, r)) &&
+					graph.getRegistryAt(tailStart + Address(tailIndex), reg, stack) &&
+					stack.height() == graph.getStack(fn.body[head])[cfg::order_entry].height();
+			}
+
+			if (!valid) {
+				pinned = true;
+				continue;
+			}
+
+			edits.drops.push_back(spill.push);
+			edits.drops.insert(edits.drops.end(), spill.pops.begin(), spill.pops.end());
+
+			Instr push(op_push);
+			Instr pop(op_pop);
+			push.setOperand(0, r, true);
+			pop.setOperand(0, r, true);
+			pushes.push_back(reloc::Insertion{ fn.body[head], 0, push });
+			pops.push_back(reloc::Insertion{ tailStart, tailIndex, pop });
+
+			regions.push_back(std::make_pair(head, tail));
+			++result.moved;
+		}
+	}
+
+	// pushes go first, so that a push and a pop at the same spot -- a region of a lone branch -- stay in order
+	edits.inserts.assign(pushes.rbegin(), pushes.rend());
+	edits.inserts.insert(edits.inserts.end(), pops.begin(), pops.end());
+
+	if (!reloc::relocate(graph, dst, image, map, edits))
+		return false;
+
+	// re-solve the relocated CFG from the relocated entry
+	const reloc::AddressMap::const_iterator it = std::lower_bound(map.begin(), map.end(), entry,
+		[](const reloc::AddressMap::value_type& lhs, const Address rhs) { return uint32_t(lhs.first) < uint32_t(rhs); });
+
+	const Registry* const entryReg = graph.getRegistry(entry);
+	const Stack* const entryStack = graph.getStack(entry);
+	if (it == map.end() || uint32_t(it->first) != uint32_t(entry) || !entryReg || !entryStack) {
+		fprintf(stderr, "error: entry %08x missing from CFG to shrink-wrap\n", uint32_t(entry));
+		return false;
+	}
+
+	Registry reg(entryReg[cfg::order_entry]);
+	return dst.setRegistry(it->second, std::move(reg), entryStack[cfg::order_entry]) && dst.solve(it->second);
+}
+
+} // namespace wrap
+
+#endif // __wrap_h